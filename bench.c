@@ -0,0 +1,209 @@
+#ifdef MJ_ENABLE_THREADS
+#define _POSIX_C_SOURCE 200112L	/* clock_gettime() */
+#include <pthread.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "minijson.h"
+
+/*
+*	parse throughput per document shape and MJ_parse_flags() specialization.
+*	minijson_bench_generic runs the same code against a library built with
+*	MJ_PARSE_ENABLED_FLAGS=0, its MJ_parse rows are the reference for the
+*	default path, which is compiled without any flag tests.
+*/
+#define BENCH_RUNS 15
+
+typedef struct
+{
+	char *json;
+	size_t top, size;
+}bench_buffer;
+
+static void bench_puts(bench_buffer *b, const char *s)
+{
+	size_t len = strlen(s);
+	if(b->top + len + 1 > b->size)
+	{
+		while(b->top + len + 1 > b->size)
+			b->size = b->size ? b->size * 2 : 4096;
+		b->json = (char*)realloc(b->json, b->size);
+	}
+	memcpy(b->json + b->top, s, len + 1);
+	b->top += len;
+}
+
+static char* bench_strings(void)
+{
+	bench_buffer b = { NULL, 0, 0 };
+	char s[64];
+	unsigned i;
+	bench_puts(&b, "[");
+	for(i = 0; i < 200000; i++)
+	{
+		sprintf(s, "%s\"user name %u, some text\"", i ? "," : "", i);
+		bench_puts(&b, s);
+		if(i % 10 == 0)
+			bench_puts(&b, ",\"tab\\tquote\\\"\"");
+	}
+	bench_puts(&b, "]");
+	return b.json;
+}
+
+static char* bench_integers(void)
+{
+	bench_buffer b = { NULL, 0, 0 };
+	char s[32];
+	unsigned i;
+	bench_puts(&b, "[");
+	for(i = 0; i < 500000; i++)
+	{
+		sprintf(s, "%s%u", i ? "," : "", i * 2654435761u % 100000000u);
+		bench_puts(&b, s);
+	}
+	bench_puts(&b, "]");
+	return b.json;
+}
+
+static char* bench_records(void)
+{
+	bench_buffer b = { NULL, 0, 0 };
+	char s[128];
+	unsigned i;
+	bench_puts(&b, "[");
+	for(i = 0; i < 100000; i++)
+	{
+		sprintf(s, "%s{\"id\":%u,\"name\":\"item %u\",\"qty\":%u,\"ok\":true}", i ? "," : "", i, i, i % 97);
+		bench_puts(&b, s);
+	}
+	bench_puts(&b, "]");
+	return b.json;
+}
+
+/* best of BENCH_RUNS, in ms */
+static double bench_parse(const char *json, int flags)
+{
+	double best = 0.0, t;
+	clock_t start;
+	MJ_value v;
+	int i;
+	for(i = 0; i < BENCH_RUNS; i++)
+	{
+		MJ_init(&v);
+		start = clock();
+		if(MJ_parse_flags(&v, json, flags) != MJ_PARSE_OK)
+		{
+			fprintf(stderr, "parse failed\n");
+			exit(1);
+		}
+		t = (clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+		MJ_free(&v);
+		if(i == 0 || t < best)
+			best = t;
+	}
+	return best;
+}
+
+static void bench_run(const char *name, const char *json, int flags, const char *flags_name)
+{
+	double ms = bench_parse(json, flags);
+	printf("%-10s %-28s %8.2f ms %8.1f MB/s\n", name, flags_name, ms, strlen(json) / 1e3 / (ms > 0 ? ms : 1e-3));
+}
+
+#ifdef MJ_ENABLE_THREADS
+/*
+*	MJ_shared_acquire() + MJ_document_release() pairs per second over all
+*	reader threads, alone and with one writer swapping versions meanwhile.
+*/
+#define BENCH_SHARED_PAIRS 200000
+
+typedef struct
+{
+	MJ_shared *s;
+	volatile int *stop;
+}bench_shared_arg;
+
+static double bench_now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void* bench_shared_reader(void *arg)
+{
+	bench_shared_arg *a = (bench_shared_arg*)arg;
+	long i;
+	for(i = 0; i < BENCH_SHARED_PAIRS; i++)
+		MJ_document_release(MJ_shared_acquire(a->s));
+	return NULL;
+}
+
+static void* bench_shared_writer(void *arg)
+{
+	bench_shared_arg *a = (bench_shared_arg*)arg;
+	MJ_value v;
+	while(!__atomic_load_n(a->stop, __ATOMIC_RELAXED))
+	{
+		MJ_init(&v);
+		MJ_parse(&v, "[1,2,3]");
+		MJ_shared_swap(a->s, MJ_freeze(&v));
+	}
+	return NULL;
+}
+
+static double bench_shared(unsigned threads, int writer)
+{
+	pthread_t tids[64], wid;
+	bench_shared_arg a;
+	volatile int stop = 0;
+	MJ_value v;
+	double start, t;
+	unsigned i;
+	MJ_init(&v);
+	MJ_parse(&v, "[1,2,3]");
+	a.s = MJ_shared_create(MJ_freeze(&v));
+	a.stop = &stop;
+	if(writer)
+		pthread_create(&wid, NULL, bench_shared_writer, &a);
+	start = bench_now();
+	for(i = 0; i < threads; i++)
+		pthread_create(&tids[i], NULL, bench_shared_reader, &a);
+	for(i = 0; i < threads; i++)
+		pthread_join(tids[i], NULL);
+	t = bench_now() - start;
+	if(writer)
+	{
+		__atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+		pthread_join(wid, NULL);
+	}
+	MJ_shared_destroy(a.s);
+	MJ_reclaim_wait();
+	return threads * (double)BENCH_SHARED_PAIRS / t / 1e6;
+}
+#endif
+
+int main()
+{
+	char *strings = bench_strings(), *integers = bench_integers(), *records = bench_records();
+	bench_run("strings", strings, MJ_PARSE_DEFAULT, "MJ_parse");
+	bench_run("strings", strings, MJ_PARSE_TRUSTED, "MJ_PARSE_TRUSTED");
+	bench_run("integers", integers, MJ_PARSE_DEFAULT, "MJ_parse");
+	bench_run("integers", integers, MJ_PARSE_INTEGER_ONLY, "MJ_PARSE_INTEGER_ONLY");
+	bench_run("records", records, MJ_PARSE_DEFAULT, "MJ_parse");
+	bench_run("records", records, MJ_PARSE_TRUSTED | MJ_PARSE_INTEGER_ONLY, "MJ_PARSE_TRUSTED|INTEGER_ONLY");
+	free(strings);
+	free(integers);
+	free(records);
+#ifdef MJ_ENABLE_THREADS
+	{
+		unsigned threads;
+		printf("\n%-8s %14s %14s   acquire+release, M pairs/s\n", "readers", "alone", "with writer");
+		for(threads = 1; threads <= 64; threads *= 2)
+			printf("%-8u %14.2f %14.2f\n", threads, bench_shared(threads, 0), bench_shared(threads, 1));
+	}
+#endif
+	return 0;
+}
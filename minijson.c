@@ -1,20 +1,65 @@
 #include "minijson.h"
 #include <assert.h>		/* assert() */
-#include <errno.h>		/* error, ERANGE */
+#include <errno.h>		/* error, ERANGE, EINTR */
+#include <limits.h>		/* INT_MIN, INT_MAX */
 #include <math.h>		/* HUGE_VAL */
 #include <stdlib.h>		/* NULL, strtod(), malloc(), realloc(), free() */
-#include <string.h>		/* memcpy() */
+#include <stdio.h>		/* sprintf() */
+#include <string.h>		/* memcpy(), memmove(), memset(), strncmp(), strcspn() */
+#ifdef MJ_ENABLE_THREADS
+#include <pthread.h>	/* pthread_create(), pthread_join(), pthread_mutex_lock() */
+#include <sched.h>		/* sched_yield() */
+#endif
+#ifndef _WIN32
+#include <sys/uio.h>	/* writev(), struct iovec */
+#include <unistd.h>		/* ssize_t */
+#endif
 
 #define EXPECT(c, ch)		do { assert(*c->json == (ch)); c->json++; } while(0)
 #define ISDIGIT(ch)			((ch) >= '0' && (ch) <= '9')
 #define ISDIGIT1TO9(ch) 	((ch) >= '1' && (ch) <= '9')
+#define ISFINITE(n)			((n) - (n) == 0.0)	/* false for NaN and infinities, isfinite() is C99 */
 #define PUTC(c, ch)			do { *(char*)MJ_context_push(c, sizeof(char)) = (ch); } while(0)
+#define PUTS(c, s, len)		memcpy(MJ_context_push(c, len), s, len)
 #define STRING_ERROR(ret)	do { c->top = head; return ret; } while(0)
 
 #ifndef MJ_PARSE_STACK_INIT_SIZE
 #define MJ_PARSE_STACK_INIT_SIZE 256
 #endif
 
+#ifndef MJ_PARSE_STRINGIFY_INIT_SIZE
+#define MJ_PARSE_STRINGIFY_INIT_SIZE 256
+#endif
+
+/* strings this long that need no escaping bypass the writer's buffer */
+#ifndef MJ_WRITER_DIRECT_SIZE
+#define MJ_WRITER_DIRECT_SIZE 1024
+#endif
+
+/* elements each thread of MJ_stringify_parallel() must get, smaller trees stay on one thread */
+#ifndef MJ_STRINGIFY_PARALLEL_MIN
+#define MJ_STRINGIFY_PARALLEL_MIN 1024
+#endif
+
+/* counters written by many threads are kept this far apart, so they never share a cache line */
+#ifndef MJ_CACHE_LINE_SIZE
+#define MJ_CACHE_LINE_SIZE 64
+#endif
+
+/*
+*	parse specializations (MJ_PARSE_TRUSTED, ...):
+*	MJ_PARSE_FIXED_FLAGS are always on, for a build that only sees one kind of input.
+*	MJ_PARSE_ENABLED_FLAGS may be honoured per call, 0 compiles every specialization out.
+*/
+#ifndef MJ_PARSE_FIXED_FLAGS
+#define MJ_PARSE_FIXED_FLAGS 0
+#endif
+#ifndef MJ_PARSE_ENABLED_FLAGS
+#define MJ_PARSE_ENABLED_FLAGS (MJ_PARSE_TRUSTED | MJ_PARSE_INTEGER_ONLY)
+#endif
+/* the flags of the parser variant being compiled, see minijson_parse.inc */
+#define HAS_FLAG(f)			((MJ_PARSE_VARIANT) & (f))
+
 /*
 *	why need stack?
 *	case if we parse string, we make a dynamic array every time.
@@ -108,9 +153,8 @@ static int MJ_parse_literal(MJ_context *c, MJ_value *v, const char *literal, MJ_
 }
 
 // number
-static int MJ_parse_number(MJ_context *c, MJ_value *v)
+static const char* MJ_scan_number(const char *p)
 {
-	const char *p = c->json;
 	if(*p == '-')
 		p++;
 	if(*p == '0')
@@ -118,14 +162,14 @@ static int MJ_parse_number(MJ_context *c, MJ_value *v)
 	else
 	{
 		if(!ISDIGIT1TO9(*p))
-			return MJ_PARSE_INVALID_VALUE;
+			return NULL;
 		for(p++; ISDIGIT(*p); p++);
 	}
 	if(*p == '.')
 	{
 		p++;
 		if(!ISDIGIT(*p))
-			return MJ_PARSE_INVALID_VALUE;
+			return NULL;
 		for(p++; ISDIGIT(*p); p++);
 	}
 	if(*p == 'e' || *p == 'E')
@@ -134,9 +178,61 @@ static int MJ_parse_number(MJ_context *c, MJ_value *v)
 		if(*p == '+' || *p == '-')
 			p++;
 		if(!ISDIGIT(*p))
-			return MJ_PARSE_INVALID_VALUE;
+			return NULL;
 		for(p++; ISDIGIT(*p); p++);
 	}
+	return p;
+}
+
+/* up to 15 digits fit a double exactly, longer ones go through strtod() */
+static int MJ_parse_integer(MJ_context *c, MJ_value *v)
+{
+	const char *p = c->json, *q;
+	double n = 0.0;
+	if(*p == '-')
+		p++;
+	if(*p == '0')
+		q = ++p;
+	else
+	{
+		if(!ISDIGIT1TO9(*p))
+			return MJ_PARSE_INVALID_VALUE;
+		for(q = p; ISDIGIT(*p); p++)
+			n = n * 10.0 + (*p - '0');
+	}
+	if(*p == '.' || *p == 'e' || *p == 'E')
+		return MJ_PARSE_INVALID_VALUE;
+	if(p - q > 15)
+	{
+		errno = 0;
+		n = strtod(q, NULL);
+		if(errno == ERANGE && n == HUGE_VAL)
+			return MJ_PARSE_INVALID_VALUE;
+	}
+	v->u.n = *c->json == '-' ? -n : n;
+	c->json = p;
+	v->type = MJ_NUMBER;
+	return MJ_PARSE_OK;
+}
+
+/* MJ_PARSE_TRUSTED: the grammar is taken on trust, strtod() finds the end */
+static int MJ_parse_number_unchecked(MJ_context *c, MJ_value *v)
+{
+	char *end;
+	errno = 0;
+	v->u.n = strtod(c->json, &end);
+	if(end == c->json || (errno == ERANGE && (v->u.n == HUGE_VAL || v->u.n == -HUGE_VAL)))
+		return MJ_PARSE_INVALID_VALUE;
+	c->json = end;
+	v->type = MJ_NUMBER;
+	return MJ_PARSE_OK;
+}
+
+static int MJ_parse_number(MJ_context *c, MJ_value *v)
+{
+	const char *p;
+	if((p = MJ_scan_number(c->json)) == NULL)
+		return MJ_PARSE_INVALID_VALUE;
 	errno = 0;
 	v->u.n = strtod(c->json, NULL);
 	if(errno == ERANGE && (v->u.n == HUGE_VAL || v->u.n == -HUGE_VAL))
@@ -191,12 +287,85 @@ static void MJ_encode_utf8(MJ_context *c, unsigned u)
     }
 }
 
-static int MJ_parse_string(MJ_context *c, MJ_value *v)
+/* p is just past a '\\', returns the position after the escape, or NULL and *ret */
+static const char* MJ_parse_escape(MJ_context *c, const char *p, int *ret)
 {
-	size_t head = c->top;
-	size_t len;
 	unsigned u, u2;
+	switch (*p++) 
+	{
+        case '\"': PUTC(c, '\"'); break;
+        case '\\': PUTC(c, '\\'); break;
+        case '/':  PUTC(c, '/' ); break;
+        case 'b':  PUTC(c, '\b'); break;
+        case 'f':  PUTC(c, '\f'); break;
+        case 'n':  PUTC(c, '\n'); break;
+        case 'r':  PUTC(c, '\r'); break;
+        case 't':  PUTC(c, '\t'); break;
+        case 'u':	/* support utf-8 */
+            *ret = MJ_PARSE_INVALID_UNICODE_HEX;
+            if (!(p = MJ_parse_hex4(p, &u)))
+                return NULL;
+            if (u >= 0xD800 && u <= 0xDBFF) /* surrogate pair */
+            { 
+                *ret = MJ_PARSE_INVALID_UNICODE_SURROGATE;
+                if (*p++ != '\\')
+                    return NULL;
+                if (*p++ != 'u')
+                    return NULL;
+                *ret = MJ_PARSE_INVALID_UNICODE_HEX;
+                if (!(p = MJ_parse_hex4(p, &u2)))
+                    return NULL;
+                *ret = MJ_PARSE_INVALID_UNICODE_SURROGATE;
+                if (u2 < 0xDC00 || u2 > 0xDFFF)
+                    return NULL;
+                u = (((u - 0xD800) << 10) | (u2 - 0xDC00)) + 0x10000;
+            }
+            MJ_encode_utf8(c, u);
+            break;
+        default:
+            *ret = MJ_PARSE_INVALID_STRING_ESCAPE;
+            return NULL;
+	}
+	return p;
+}
+
+/* MJ_PARSE_TRUSTED: no control chars to reject, copy everything up to '"' or '\\' at once */
+static int MJ_parse_string_unchecked(MJ_context *c, char **str, size_t *len)
+{
+	size_t head = c->top, run;
+	const char *p;
+	int ret;
+	EXPECT(c, '\"');
+	p = c->json;
+	while(1)
+	{
+		if((run = strcspn(p, "\"\\")) > 0)
+		{
+			memcpy(MJ_context_push(c, run), p, run);
+			p += run;
+		}
+		switch (*p++)
+		{
+            case '\"':
+                *len = c->top - head;
+                *str = (char*)MJ_context_pop(c, *len);
+                c->json = p;
+                return MJ_PARSE_OK;
+            case '\\':
+                if (!(p = MJ_parse_escape(c, p, &ret)))
+                    STRING_ERROR(ret);
+                break;
+            default:
+                STRING_ERROR(MJ_PARSE_MISS_QUOTATION_MARK);
+		}
+	}
+}
+
+static int MJ_parse_string_checked(MJ_context *c, char **str, size_t *len)
+{
+	size_t head = c->top;
 	const char *p;
+	int ret;
 	EXPECT(c, '\"');
 	p = c->json;
 	while(1)
@@ -205,41 +374,13 @@ static int MJ_parse_string(MJ_context *c, MJ_value *v)
 		switch (ch) 
 		{
             case '\"':
-                len = c->top - head;
-                MJ_set_string(v, (const char*)MJ_context_pop(c, len), len);
+                *len = c->top - head;
+                *str = (char*)MJ_context_pop(c, *len);
                 c->json = p;
                 return MJ_PARSE_OK;
             case '\\':
-                switch (*p++) 
-                {
-                    case '\"': PUTC(c, '\"'); break;
-                    case '\\': PUTC(c, '\\'); break;
-                    case '/':  PUTC(c, '/' ); break;
-                    case 'b':  PUTC(c, '\b'); break;
-                    case 'f':  PUTC(c, '\f'); break;
-                    case 'n':  PUTC(c, '\n'); break;
-                    case 'r':  PUTC(c, '\r'); break;
-                    case 't':  PUTC(c, '\t'); break;
-                    case 'u':	/* support utf-8 */
-                        if (!(p = MJ_parse_hex4(p, &u)))
-                            STRING_ERROR(MJ_PARSE_INVALID_UNICODE_HEX);
-                        if (u >= 0xD800 && u <= 0xDBFF) /* surrogate pair */
-                        { 
-                            if (*p++ != '\\')
-                                STRING_ERROR(MJ_PARSE_INVALID_UNICODE_SURROGATE);
-                            if (*p++ != 'u')
-                                STRING_ERROR(MJ_PARSE_INVALID_UNICODE_SURROGATE);
-                            if (!(p = MJ_parse_hex4(p, &u2)))
-                                STRING_ERROR(MJ_PARSE_INVALID_UNICODE_HEX);
-                            if (u2 < 0xDC00 || u2 > 0xDFFF)
-                                STRING_ERROR(MJ_PARSE_INVALID_UNICODE_SURROGATE);
-                            u = (((u - 0xD800) << 10) | (u2 - 0xDC00)) + 0x10000;
-                        }
-                        MJ_encode_utf8(c, u);
-                        break;
-                    default:
-                        STRING_ERROR(MJ_PARSE_INVALID_STRING_ESCAPE);
-                }
+                if (!(p = MJ_parse_escape(c, p, &ret)))
+                    STRING_ERROR(ret);
                 break;
             case '\0':
                 c->top = head;
@@ -247,37 +388,96 @@ static int MJ_parse_string(MJ_context *c, MJ_value *v)
             default:
                 if ((unsigned char)ch < 0x20) 
                 { 
-                    STRING_ERROR(MJ_PARSE_INVALID_STRING_ESCAPE);
+                    STRING_ERROR(MJ_PARSE_INVALID_STRING_CHAR);
                 }
                 PUTC(c, ch);
         }
 	}
 }
 
-static int MJ_parse_value(MJ_context *c, MJ_value *v);
+/*
+*	the recursive parser is compiled once per variant of MJ_parse_flags(),
+*	with its flags as a constant, so MJ_parse() carries no flag tests.
+*/
+#define MJ_PARSE_VARIANT	(MJ_PARSE_FIXED_FLAGS)
+#define MJ_PARSE_NAME(name)	name
+#include "minijson_parse.inc"
+#define MJ_PARSE_VARIANT	(MJ_PARSE_FIXED_FLAGS | MJ_PARSE_TRUSTED)
+#define MJ_PARSE_NAME(name)	name##_trusted
+#include "minijson_parse.inc"
+#define MJ_PARSE_VARIANT	(MJ_PARSE_FIXED_FLAGS | MJ_PARSE_INTEGER_ONLY)
+#define MJ_PARSE_NAME(name)	name##_integer
+#include "minijson_parse.inc"
+#define MJ_PARSE_VARIANT	(MJ_PARSE_FIXED_FLAGS | MJ_PARSE_TRUSTED | MJ_PARSE_INTEGER_ONLY)
+#define MJ_PARSE_NAME(name)	name##_trusted_integer
+#include "minijson_parse.inc"
+
+/*
+*	skip: walk over one value with the same grammar as MJ_parse_value,
+*	but never touch the stack, decode escapes or convert numbers.
+*/
+static int MJ_skip_value(MJ_context *c);
+
+static int MJ_skip_string(MJ_context *c)
+{
+	unsigned u, u2;
+	const char *p;
+	EXPECT(c, '\"');
+	p = c->json;
+	while(1)
+	{
+		char ch = *p++;
+		switch(ch)
+		{
+			case '\"':
+				c->json = p;
+				return MJ_PARSE_OK;
+			case '\\':
+				switch(*p++)
+				{
+					case '\"': case '\\': case '/':
+					case 'b': case 'f': case 'n': case 'r': case 't':
+						break;
+					case 'u':
+						if(!(p = MJ_parse_hex4(p, &u)))
+							return MJ_PARSE_INVALID_UNICODE_HEX;
+						if(u >= 0xD800 && u <= 0xDBFF)
+						{
+							if(*p++ != '\\' || *p++ != 'u')
+								return MJ_PARSE_INVALID_UNICODE_SURROGATE;
+							if(!(p = MJ_parse_hex4(p, &u2)))
+								return MJ_PARSE_INVALID_UNICODE_HEX;
+							if(u2 < 0xDC00 || u2 > 0xDFFF)
+								return MJ_PARSE_INVALID_UNICODE_SURROGATE;
+						}
+						break;
+					default:
+						return MJ_PARSE_INVALID_STRING_ESCAPE;
+				}
+				break;
+			case '\0':
+				return MJ_PARSE_MISS_QUOTATION_MARK;
+			default:
+				if((unsigned char)ch < 0x20)
+					return MJ_PARSE_INVALID_STRING_CHAR;
+		}
+	}
+}
 
-static int MJ_parse_array(MJ_context *c, MJ_value *v)
+static int MJ_skip_array(MJ_context *c)
 {
-	size_t size = 0;
 	int ret;
 	EXPECT(c, '[');
 	MJ_parse_whitespace(c);
 	if(*c->json == ']')
 	{
 		c->json++;
-		v->type = MJ_ARRAY;
-		v->u.a.size = 0;
-		v->u.a.e = NULL;
 		return MJ_PARSE_OK;
 	}
 	while(1)
 	{
-		MJ_value e;
-		MJ_init(&e);
-		if((ret = MJ_parse_value(c, &e)) != MJ_PARSE_OK)
-			break;
-		memcpy(MJ_context_push(c, sizeof(MJ_value)), &e, sizeof(MJ_value));
-		size++;
+		if((ret = MJ_skip_value(c)) != MJ_PARSE_OK)
+			return ret;
 		MJ_parse_whitespace(c);
 		if(*c->json == ',')
 		{
@@ -287,39 +487,74 @@ static int MJ_parse_array(MJ_context *c, MJ_value *v)
 		else if(*c->json == ']')
 		{
 			c->json++;
-			v->type = MJ_ARRAY;
-			v->u.a.size = size;
-			size *= sizeof(MJ_value);
-			memcpy(v->u.a.e = (MJ_value*)malloc(size), MJ_context_pop(c, size), size);
 			return MJ_PARSE_OK;
 		}
 		else
+			return MJ_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+	}
+}
+
+static int MJ_skip_object(MJ_context *c)
+{
+	int ret;
+	EXPECT(c, '{');
+	MJ_parse_whitespace(c);
+	if(*c->json == '}')
+	{
+		c->json++;
+		return MJ_PARSE_OK;
+	}
+	while(1)
+	{
+		if(*c->json != '"')
+			return MJ_PARSE_MISS_KEY;
+		if((ret = MJ_skip_string(c)) != MJ_PARSE_OK)
+			return ret;
+		MJ_parse_whitespace(c);
+		if(*c->json != ':')
+			return MJ_PARSE_MISS_COLON;
+		c->json++;
+		MJ_parse_whitespace(c);
+		if((ret = MJ_skip_value(c)) != MJ_PARSE_OK)
+			return ret;
+		MJ_parse_whitespace(c);
+		if(*c->json == ',')
 		{
-			ret = MJ_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
-			break;
+			c->json++;
+			MJ_parse_whitespace(c);
+		}
+		else if(*c->json == '}')
+		{
+			c->json++;
+			return MJ_PARSE_OK;
 		}
+		else
+			return MJ_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
 	}
-	/* Pop and free values on the stack */
-	for(size_t i = 0; i < size; ++i)
-		MJ_free((MJ_value *)MJ_context_pop(c, sizeof(MJ_value)));
-	return ret;
 }
 
-static int MJ_parse_value(MJ_context *c, MJ_value *v)
+static int MJ_skip_value(MJ_context *c)
 {
+	MJ_value tmp;	/* literals only set the type */
+	const char *p;
 	switch(*c->json)
 	{
-		case 't': return MJ_parse_literal(c, v, "true", MJ_TRUE);
-		case 'f': return MJ_parse_literal(c, v, "false", MJ_FALSE);
-		case 'n': return MJ_parse_literal(c, v, "null", MJ_NULL);
-		default: return MJ_parse_number(c, v);
-		case '"':  return MJ_parse_string(c, v);
-		case '[':  return MJ_parse_array(c, v);
+		case 't': return MJ_parse_literal(c, &tmp, "true", MJ_TRUE);
+		case 'f': return MJ_parse_literal(c, &tmp, "false", MJ_FALSE);
+		case 'n': return MJ_parse_literal(c, &tmp, "null", MJ_NULL);
+		default:
+			if((p = MJ_scan_number(c->json)) == NULL)
+				return MJ_PARSE_INVALID_VALUE;
+			c->json = p;
+			return MJ_PARSE_OK;
+		case '"':  return MJ_skip_string(c);
+		case '[':  return MJ_skip_array(c);
+		case '{':  return MJ_skip_object(c);
 		case '\0': return MJ_PARSE_EXPECT_VALUE;
 	}
 }
 
-int MJ_parse(MJ_value *v, const char *json)
+static int MJ_parse_root(MJ_value *v, const char *json, int (*parse)(MJ_context *c, MJ_value *v))
 {
 	MJ_context c;
 	int ret;
@@ -329,7 +564,7 @@ int MJ_parse(MJ_value *v, const char *json)
 	c.size = c.top = 0;
 	MJ_init(v);
 	MJ_parse_whitespace(&c);
-	if((ret = MJ_parse_value(&c, v)) == MJ_PARSE_OK)
+	if((ret = parse(&c, v)) == MJ_PARSE_OK)
 	{
 		MJ_parse_whitespace(&c);
 		if(*c.json != '\0')
@@ -343,64 +578,1171 @@ int MJ_parse(MJ_value *v, const char *json)
 	return ret;
 }
 
-void MJ_free(MJ_value *v)
+int MJ_parse(MJ_value *v, const char *json)
 {
-	size_t i;
-	assert(v != NULL);
-	switch(v->type)
+	return MJ_parse_root(v, json, MJ_parse_value);
+}
+
+int MJ_parse_flags(MJ_value *v, const char *json, unsigned flags)
+{
+	switch(flags & MJ_PARSE_ENABLED_FLAGS & (MJ_PARSE_TRUSTED | MJ_PARSE_INTEGER_ONLY))
 	{
-		case MJ_STRING:
-			free(v->u.s.s);
-			break;
-		case MJ_ARRAY:
-			for(i = 0; i < v->u.a.size; i++)
-				MJ_free(&v->u.a.e[i]);
-			free(v->u.a.e);
-			break;
+		case MJ_PARSE_TRUSTED:
+			return MJ_parse_root(v, json, MJ_parse_value_trusted);
+		case MJ_PARSE_INTEGER_ONLY:
+			return MJ_parse_root(v, json, MJ_parse_value_integer);
+		case MJ_PARSE_TRUSTED | MJ_PARSE_INTEGER_ONLY:
+			return MJ_parse_root(v, json, MJ_parse_value_trusted_integer);
 		default:
-			break;
+			return MJ_parse_root(v, json, MJ_parse_value);
 	}
-	v->type = MJ_NULL;
 }
 
-MJ_type MJ_get_type(const MJ_value *v)
+int MJ_validate(const char *json)
 {
-	assert(v != NULL);
-	return v->type;
+	MJ_context c;
+	int ret;
+	assert(json != NULL);
+	c.json = json;
+	c.stack = NULL;
+	c.size = c.top = 0;
+	MJ_parse_whitespace(&c);
+	if((ret = MJ_skip_value(&c)) == MJ_PARSE_OK)
+	{
+		MJ_parse_whitespace(&c);
+		if(*c.json != '\0')
+			ret = MJ_PARSE_ROOT_NOT_SINGULAR;
+	}
+	return ret;
 }
 
-int MJ_get_boolean(const MJ_value *v) 
+int MJ_skip(const char *json, size_t *end)
 {
-    assert(v != NULL && (v->type == MJ_TRUE || v->type == MJ_FALSE));
-    return v->type == MJ_TRUE;
+	MJ_context c;
+	int ret;
+	assert(json != NULL && end != NULL);
+	c.json = json;
+	c.stack = NULL;
+	c.size = c.top = 0;
+	MJ_parse_whitespace(&c);
+	if((ret = MJ_skip_value(&c)) == MJ_PARSE_OK)
+		*end = (size_t)(c.json - json);
+	return ret;
 }
 
-void MJ_set_boolean(MJ_value *v, int b) 
+/*
+*	struct: parse an object straight into a caller's struct,
+*	the fields table maps keys to members, unknown keys are skipped.
+*/
+static const MJ_field* MJ_find_field(const MJ_field *fields, size_t count, const char *key, size_t len, size_t *hint)
 {
-    MJ_free(v);
-    v->type = b ? MJ_TRUE : MJ_FALSE;
+	size_t i, j;
+	/* members usually come in table order, so start after the last match */
+	for(i = 0, j = *hint; i < count; i++, j = (j + 1 == count) ? 0 : j + 1)
+	{
+		if(fields[j].klen == len && memcmp(fields[j].key, key, len) == 0)
+		{
+			*hint = j + 1 == count ? 0 : j + 1;
+			return &fields[j];
+		}
+	}
+	return NULL;
 }
 
-void MJ_set_number(MJ_value *v, double n) 
+static int MJ_parse_field(MJ_context *c, const MJ_field *f, char *base, int *present)
 {
-    MJ_free(v);
-    v->u.n = n;
-    v->type = MJ_NUMBER;
+	MJ_value tmp;
+	char *s;
+	size_t len;
+	int ret;
+	assert(f->type == MJ_FIELD_STRING || f->size == (f->type == MJ_FIELD_NUMBER ? sizeof(double) : sizeof(int)));
+	*present = 1;
+	if(*c->json == '"')
+	{
+		if(f->type != MJ_FIELD_STRING)
+			return MJ_PARSE_FIELD_MISMATCH;
+		if((ret = MJ_parse_string_raw(c, &s, &len)) != MJ_PARSE_OK)
+			return ret;
+		if(len >= f->size)
+			return MJ_PARSE_FIELD_MISMATCH;
+		memcpy(base + f->offset, s, len);
+		base[f->offset + len] = '\0';
+		return MJ_PARSE_OK;
+	}
+	if(*c->json == '[' || *c->json == '{')
+		return MJ_PARSE_FIELD_MISMATCH;
+	MJ_init(&tmp);
+	if((ret = MJ_parse_value(c, &tmp)) != MJ_PARSE_OK)
+		return ret;
+	switch(tmp.type)
+	{
+		case MJ_NULL:
+			*present = 0;
+			return MJ_PARSE_OK;
+		case MJ_FALSE:
+		case MJ_TRUE:
+			if(f->type != MJ_FIELD_BOOLEAN)
+				return MJ_PARSE_FIELD_MISMATCH;
+			*(int*)(base + f->offset) = tmp.type == MJ_TRUE;
+			return MJ_PARSE_OK;
+		default:
+			assert(tmp.type == MJ_NUMBER);
+			if(f->type == MJ_FIELD_NUMBER)
+			{
+				*(double*)(base + f->offset) = tmp.u.n;
+				return MJ_PARSE_OK;
+			}
+			if(f->type != MJ_FIELD_INT || tmp.u.n < INT_MIN || tmp.u.n > INT_MAX || tmp.u.n != (int)tmp.u.n)
+				return MJ_PARSE_FIELD_MISMATCH;
+			*(int*)(base + f->offset) = (int)tmp.u.n;
+			return MJ_PARSE_OK;
+	}
 }
 
-double MJ_get_number(const MJ_value *v)
+static int MJ_parse_struct_object(MJ_context *c, char *base, const MJ_field *fields, size_t count)
 {
-	assert(v != NULL && v->type == MJ_NUMBER);
-	return v->u.n;
+	size_t head = c->top, hint = 0, i, len;
+	const MJ_field *f;
+	char *key;
+	int ret = MJ_PARSE_OK, present;
+	EXPECT(c, '{');
+	/* one "seen" flag per field, kept on the stack below any string */
+	memset(MJ_context_push(c, count + 1), 0, count + 1);
+	MJ_parse_whitespace(c);
+	if(*c->json == '}')
+		c->json++;
+	else while(1)
+	{
+		if(*c->json != '"')
+		{
+			ret = MJ_PARSE_MISS_KEY;
+			break;
+		}
+		if((ret = MJ_parse_string_raw(c, &key, &len)) != MJ_PARSE_OK)
+			break;
+		f = MJ_find_field(fields, count, key, len, &hint);
+		MJ_parse_whitespace(c);
+		if(*c->json != ':')
+		{
+			ret = MJ_PARSE_MISS_COLON;
+			break;
+		}
+		c->json++;
+		MJ_parse_whitespace(c);
+		if(f == NULL)
+			ret = MJ_skip_value(c);
+		else if((ret = MJ_parse_field(c, f, base, &present)) == MJ_PARSE_OK)
+			c->stack[head + (f - fields)] = (char)present;
+		if(ret != MJ_PARSE_OK)
+			break;
+		MJ_parse_whitespace(c);
+		if(*c->json == ',')
+		{
+			c->json++;
+			MJ_parse_whitespace(c);
+		}
+		else if(*c->json == '}')
+		{
+			c->json++;
+			break;
+		}
+		else
+		{
+			ret = MJ_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+			break;
+		}
+	}
+	for(i = 0; ret == MJ_PARSE_OK && i < count; i++)
+		if(fields[i].required && !c->stack[head + i])
+			ret = MJ_PARSE_MISS_REQUIRED_FIELD;
+	c->top = head;
+	return ret;
 }
 
-const char* MJ_get_string(const MJ_value *v) 
+int MJ_parse_struct(void *s, const MJ_field *fields, size_t count, const char *json)
 {
-    assert(v != NULL && v->type == MJ_STRING);
-    return v->u.s.s;
+	MJ_context c;
+	int ret;
+	assert(s != NULL && (fields != NULL || count == 0) && json != NULL);
+	c.json = json;
+	c.stack = NULL;
+	c.size = c.top = 0;
+	MJ_parse_whitespace(&c);
+	if(*c.json == '{')
+		ret = MJ_parse_struct_object(&c, (char*)s, fields, count);
+	else if((ret = MJ_skip_value(&c)) == MJ_PARSE_OK)
+		ret = MJ_PARSE_FIELD_MISMATCH;
+	if(ret == MJ_PARSE_OK)
+	{
+		MJ_parse_whitespace(&c);
+		if(*c.json != '\0')
+			ret = MJ_PARSE_ROOT_NOT_SINGULAR;
+	}
+	assert(c.top == 0);
+	free(c.stack);
+	return ret;
 }
 
-size_t MJ_get_string_length(const MJ_value *v) 
+/*
+*	stringify: the whole output is built on the context stack,
+*	arrays and objects are written a range of elements at a time so the
+*	parallel writer produces the same bytes.
+*/
+static void MJ_stringify_value(MJ_context *c, const MJ_value *v);
+
+/* escape len bytes of s to p, which needs room for len * 6 bytes ("\u00xx...") */
+static char* MJ_escape(char *p, const char *s, size_t len)
+{
+	static const char hex_digits[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
+	size_t i;
+	for(i = 0; i < len; i++)
+	{
+		unsigned char ch = (unsigned char)s[i];
+		switch(ch)
+		{
+			case '\"': *p++ = '\\'; *p++ = '\"'; break;
+			case '\\': *p++ = '\\'; *p++ = '\\'; break;
+			case '\b': *p++ = '\\'; *p++ = 'b';  break;
+			case '\f': *p++ = '\\'; *p++ = 'f';  break;
+			case '\n': *p++ = '\\'; *p++ = 'n';  break;
+			case '\r': *p++ = '\\'; *p++ = 'r';  break;
+			case '\t': *p++ = '\\'; *p++ = 't';  break;
+			default:
+				if(ch < 0x20)
+				{
+					*p++ = '\\'; *p++ = 'u'; *p++ = '0'; *p++ = '0';
+					*p++ = hex_digits[ch >> 4];
+					*p++ = hex_digits[ch & 15];
+				}
+				else
+					*p++ = s[i];
+		}
+	}
+	return p;
+}
+
+static int MJ_is_escape_free(const char *s, size_t len)
+{
+	size_t i;
+	for(i = 0; i < len; i++)
+		if((unsigned char)s[i] < 0x20 || s[i] == '"' || s[i] == '\\')
+			return 0;
+	return 1;
+}
+
+static void MJ_stringify_string(MJ_context *c, const char *s, size_t len)
+{
+	size_t size;
+	char *head, *p;
+	assert(s != NULL || len == 0);
+	p = head = (char*)MJ_context_push(c, size = len * 6 + 2);
+	*p++ = '"';
+	p = MJ_escape(p, s, len);
+	*p++ = '"';
+	c->top -= size - (size_t)(p - head);
+}
+
+/* elements [begin, end) of an array, or members of an object, comma separated */
+static void MJ_stringify_range(MJ_context *c, const MJ_value *v, size_t begin, size_t end)
+{
+	size_t i;
+	for(i = begin; i < end; i++)
+	{
+		if(i > begin)
+			PUTC(c, ',');
+		if(v->type == MJ_ARRAY)
+			MJ_stringify_value(c, &v->u.a.e[i]);
+		else
+		{
+			MJ_stringify_string(c, v->u.o.m[i].k, v->u.o.m[i].klen);
+			PUTC(c, ':');
+			MJ_stringify_value(c, &v->u.o.m[i].v);
+		}
+	}
+}
+
+static void MJ_stringify_value(MJ_context *c, const MJ_value *v)
+{
+	switch(v->type)
+	{
+		case MJ_NULL:   PUTS(c, "null",  4); break;
+		case MJ_FALSE:  PUTS(c, "false", 5); break;
+		case MJ_TRUE:   PUTS(c, "true",  4); break;
+		case MJ_NUMBER:
+			/* JSON has no NaN or infinity */
+			if(!ISFINITE(v->u.n))
+				PUTS(c, "null", 4);
+			else
+				c->top -= 32 - sprintf((char*)MJ_context_push(c, 32), "%.17g", v->u.n);
+			break;
+		case MJ_STRING: MJ_stringify_string(c, v->u.s.s, v->u.s.len); break;
+		case MJ_ARRAY:
+			PUTC(c, '[');
+			MJ_stringify_range(c, v, 0, v->u.a.size);
+			PUTC(c, ']');
+			break;
+		case MJ_OBJECT:
+			PUTC(c, '{');
+			MJ_stringify_range(c, v, 0, v->u.o.size);
+			PUTC(c, '}');
+			break;
+		default: assert(0 && "invalid type");
+	}
+}
+
+char* MJ_stringify(const MJ_value *v, size_t *length)
+{
+	MJ_context c;
+	assert(v != NULL);
+	c.stack = (char*)malloc(c.size = MJ_PARSE_STRINGIFY_INIT_SIZE);
+	c.top = 0;
+	MJ_stringify_value(&c, v);
+	if(length)
+		*length = c.top;
+	PUTC(&c, '\0');
+	return c.stack;
+}
+
+#ifdef MJ_ENABLE_THREADS
+/* a range of one large container, written by a worker and spliced into the serial text at offset */
+typedef struct
+{
+	const MJ_value *v;
+	size_t begin, end, offset;
+	MJ_context c;
+}MJ_stringify_chunk;
+
+typedef struct
+{
+	MJ_context c;				/* the text around the chunks */
+	MJ_stringify_chunk *chunks;
+	size_t count, capacity;
+	unsigned threads;
+}MJ_stringify_plan;
+
+typedef struct
+{
+	MJ_stringify_chunk *chunks;
+	size_t first, count, step;
+	int started;
+}MJ_stringify_task;
+
+static void* MJ_stringify_worker(void *arg)
+{
+	MJ_stringify_task *t = (MJ_stringify_task*)arg;
+	size_t i;
+	for(i = t->first; i < t->count; i += t->step)
+		MJ_stringify_range(&t->chunks[i].c, t->chunks[i].v, t->chunks[i].begin, t->chunks[i].end);
+	return NULL;
+}
+
+/*
+*	write v serially, but cut every container that can give each thread
+*	MJ_STRINGIFY_PARALLEL_MIN elements into chunks. smaller containers are
+*	walked, so a large array under a small object is still split.
+*/
+static void MJ_stringify_split(MJ_stringify_plan *p, const MJ_value *v)
+{
+	MJ_stringify_chunk *k;
+	size_t size, n, i;
+	if(v->type != MJ_ARRAY && v->type != MJ_OBJECT)
+	{
+		MJ_stringify_value(&p->c, v);
+		return;
+	}
+	size = v->type == MJ_ARRAY ? v->u.a.size : v->u.o.size;
+	n = size / MJ_STRINGIFY_PARALLEL_MIN;
+	if(n > p->threads)
+		n = p->threads;
+	PUTC(&p->c, v->type == MJ_ARRAY ? '[' : '{');
+	if(n >= 2)
+	{
+		if(p->count + n > p->capacity)
+		{
+			p->capacity = p->capacity * 2 + n;
+			p->chunks = (MJ_stringify_chunk*)realloc(p->chunks, p->capacity * sizeof(MJ_stringify_chunk));
+		}
+		for(i = 0; i < n; i++)
+		{
+			/* the comma between two chunks stays in the serial text */
+			if(i > 0)
+				PUTC(&p->c, ',');
+			k = &p->chunks[p->count++];
+			k->v = v;
+			k->begin = size / n * i;
+			k->end = i + 1 == n ? size : size / n * (i + 1);
+			k->offset = p->c.top;
+			k->c.stack = NULL;
+			k->c.size = k->c.top = 0;
+		}
+	}
+	else
+	{
+		for(i = 0; i < size; i++)
+		{
+			if(i > 0)
+				PUTC(&p->c, ',');
+			if(v->type == MJ_ARRAY)
+				MJ_stringify_split(p, &v->u.a.e[i]);
+			else
+			{
+				MJ_stringify_string(&p->c, v->u.o.m[i].k, v->u.o.m[i].klen);
+				PUTC(&p->c, ':');
+				MJ_stringify_split(p, &v->u.o.m[i].v);
+			}
+		}
+	}
+	PUTC(&p->c, v->type == MJ_ARRAY ? ']' : '}');
+}
+#endif
+
+char* MJ_stringify_parallel(const MJ_value *v, size_t *length, unsigned threads)
+{
+#ifdef MJ_ENABLE_THREADS
+	MJ_stringify_plan p;
+	MJ_stringify_task *tasks;
+	pthread_t *tids;
+	size_t total, from, i;
+	char *json, *q;
+	assert(v != NULL && threads > 0);
+	if(threads < 2)
+		return MJ_stringify(v, length);
+	p.c.stack = (char*)malloc(p.c.size = MJ_PARSE_STRINGIFY_INIT_SIZE);
+	p.c.top = 0;
+	p.chunks = NULL;
+	p.count = p.capacity = 0;
+	p.threads = threads;
+	MJ_stringify_split(&p, v);
+	if(p.count == 0)
+	{
+		if(length)
+			*length = p.c.top;
+		PUTC(&p.c, '\0');
+		return p.c.stack;
+	}
+	if(threads > p.count)
+		threads = (unsigned)p.count;
+	tasks = (MJ_stringify_task*)malloc(threads * sizeof(MJ_stringify_task));
+	tids = (pthread_t*)malloc(threads * sizeof(pthread_t));
+	for(i = 0; i < threads; i++)
+	{
+		tasks[i].chunks = p.chunks;
+		tasks[i].first = i;
+		tasks[i].count = p.count;
+		tasks[i].step = threads;
+		/* the calling thread takes task 0, a task is done inline if its thread fails to start */
+		tasks[i].started = i > 0 && pthread_create(&tids[i], NULL, MJ_stringify_worker, &tasks[i]) == 0;
+	}
+	for(i = 0; i < threads; i++)
+	{
+		if(tasks[i].started)
+			pthread_join(tids[i], NULL);
+		else
+			MJ_stringify_worker(&tasks[i]);
+	}
+	total = p.c.top;
+	for(i = 0; i < p.count; i++)
+		total += p.chunks[i].c.top;
+	q = json = (char*)malloc(total + 1);
+	for(i = 0, from = 0; i < p.count; i++)
+	{
+		memcpy(q, p.c.stack + from, p.chunks[i].offset - from);
+		q += p.chunks[i].offset - from;
+		from = p.chunks[i].offset;
+		memcpy(q, p.chunks[i].c.stack, p.chunks[i].c.top);
+		q += p.chunks[i].c.top;
+		free(p.chunks[i].c.stack);
+	}
+	memcpy(q, p.c.stack + from, p.c.top - from);
+	json[total] = '\0';
+	if(length)
+		*length = total;
+	free(p.c.stack);
+	free(p.chunks);
+	free(tasks);
+	free(tids);
+	return json;
+#else
+	(void)threads;
+	return MJ_stringify(v, length);
+#endif
+}
+
+/*
+*	writer: values are escaped into a fixed buffer that is flushed when
+*	full, so memory stays constant whatever the size of the output.
+*/
+#if MJ_WRITER_BUFFER_SIZE < 64
+#error "MJ_WRITER_BUFFER_SIZE must be at least 64"
+#endif
+
+#define MJ_WRITER_OBJECT	1	/* level is an object */
+#define MJ_WRITER_NONEMPTY	2	/* level has a value, the next one needs a ',' */
+#define MJ_WRITER_KEY		4	/* a key was written, its value is next */
+
+#ifndef _WIN32
+static int MJ_write_fd(int fd, const char *a, size_t alen, const char *b, size_t blen)
+{
+	struct iovec iov[2];
+	ssize_t n;
+	int skip;
+	iov[0].iov_base = (void*)a;
+	iov[0].iov_len = alen;
+	iov[1].iov_base = (void*)b;
+	iov[1].iov_len = blen;
+	while(iov[0].iov_len + iov[1].iov_len > 0)
+	{
+		skip = iov[0].iov_len == 0;
+		if((n = writev(fd, iov + skip, 2 - skip)) < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return -1;
+		}
+		if((size_t)n >= iov[0].iov_len)
+		{
+			n -= (ssize_t)iov[0].iov_len;
+			iov[0].iov_len = 0;
+			iov[1].iov_base = (char*)iov[1].iov_base + n;
+			iov[1].iov_len -= (size_t)n;
+		}
+		else
+		{
+			iov[0].iov_base = (char*)iov[0].iov_base + n;
+			iov[0].iov_len -= (size_t)n;
+		}
+	}
+	return 0;
+}
+#endif
+
+/* write out the buffer, followed by payload which is never copied */
+static int MJ_writer_emit(MJ_writer *w, const char *payload, size_t len)
+{
+	int failed;
+	if(w->error)
+		return w->error;
+#ifndef _WIN32
+	if(w->fd >= 0)
+		failed = MJ_write_fd(w->fd, w->buffer, w->top, payload, len) != 0;
+	else
+#endif
+		failed = (w->top > 0 && w->write(w->user, w->buffer, w->top) != 0) ||
+			(len > 0 && w->write(w->user, payload, len) != 0);
+	w->top = 0;
+	if(failed)
+		w->error = MJ_WRITE_IO_ERROR;
+	return w->error;
+}
+
+static int MJ_writer_reserve(MJ_writer *w, size_t size)
+{
+	assert(size <= MJ_WRITER_BUFFER_SIZE);
+	if(w->top + size > MJ_WRITER_BUFFER_SIZE)
+		return MJ_writer_emit(w, NULL, 0);
+	return w->error;
+}
+
+static int MJ_writer_puts(MJ_writer *w, const char *s, size_t len)
+{
+	if(MJ_writer_reserve(w, len) == MJ_WRITE_OK)
+	{
+		memcpy(w->buffer + w->top, s, len);
+		w->top += len;
+	}
+	return w->error;
+}
+
+/* the ',' before a value, and checks a value is allowed here */
+static int MJ_writer_prefix(MJ_writer *w)
+{
+	unsigned char *level = &w->levels[w->depth];
+	if(w->error)
+		return w->error;
+	if(*level & MJ_WRITER_OBJECT)
+	{
+		if(!(*level & MJ_WRITER_KEY))
+			return w->error = MJ_WRITE_INVALID_STATE;
+		*level &= ~MJ_WRITER_KEY;
+		return MJ_WRITE_OK;
+	}
+	if(*level & MJ_WRITER_NONEMPTY)
+	{
+		if(w->depth == 0)	/* a second root value */
+			return w->error = MJ_WRITE_INVALID_STATE;
+		MJ_writer_puts(w, ",", 1);
+	}
+	*level |= MJ_WRITER_NONEMPTY;
+	return w->error;
+}
+
+static int MJ_writer_string(MJ_writer *w, const char *s, size_t len)
+{
+	size_t i, n;
+	assert(s != NULL || len == 0);
+	if(MJ_writer_puts(w, "\"", 1) != MJ_WRITE_OK)
+		return w->error;
+	if(len >= MJ_WRITER_DIRECT_SIZE && MJ_is_escape_free(s, len))
+		MJ_writer_emit(w, s, len);
+	else
+	{
+		for(i = 0; i < len && MJ_writer_reserve(w, 6) == MJ_WRITE_OK; i += n)
+		{
+			/* an escaped byte takes at most 6 bytes */
+			n = (MJ_WRITER_BUFFER_SIZE - w->top) / 6;
+			if(n > len - i)
+				n = len - i;
+			w->top = (size_t)(MJ_escape(w->buffer + w->top, s + i, n) - w->buffer);
+		}
+	}
+	return MJ_writer_puts(w, "\"", 1);
+}
+
+static int MJ_writer_begin(MJ_writer *w, char ch, unsigned char type)
+{
+	if(MJ_writer_prefix(w) != MJ_WRITE_OK)
+		return w->error;
+	if(w->depth + 1 == MJ_WRITER_MAX_DEPTH)
+		return w->error = MJ_WRITE_TOO_DEEP;
+	w->levels[++w->depth] = type;
+	return MJ_writer_puts(w, &ch, 1);
+}
+
+static int MJ_writer_end(MJ_writer *w, char ch, unsigned char type)
+{
+	if(w->error)
+		return w->error;
+	if(w->depth == 0 || (w->levels[w->depth] & (MJ_WRITER_OBJECT | MJ_WRITER_KEY)) != type)
+		return w->error = MJ_WRITE_INVALID_STATE;
+	w->depth--;
+	return MJ_writer_puts(w, &ch, 1);
+}
+
+void MJ_writer_init(MJ_writer *w, MJ_write_func func, void *user)
+{
+	assert(w != NULL && func != NULL);
+	w->write = func;
+	w->user = user;
+	w->fd = -1;
+	w->top = 0;
+	w->depth = 0;
+	w->levels[0] = 0;
+	w->error = MJ_WRITE_OK;
+}
+
+#ifndef _WIN32
+void MJ_writer_init_fd(MJ_writer *w, int fd)
+{
+	assert(w != NULL && fd >= 0);
+	w->write = NULL;
+	w->user = NULL;
+	w->fd = fd;
+	w->top = 0;
+	w->depth = 0;
+	w->levels[0] = 0;
+	w->error = MJ_WRITE_OK;
+}
+#endif
+
+int MJ_write_begin_array(MJ_writer *w)
+{
+	assert(w != NULL);
+	return MJ_writer_begin(w, '[', 0);
+}
+
+int MJ_write_end_array(MJ_writer *w)
+{
+	assert(w != NULL);
+	return MJ_writer_end(w, ']', 0);
+}
+
+int MJ_write_begin_object(MJ_writer *w)
+{
+	assert(w != NULL);
+	return MJ_writer_begin(w, '{', MJ_WRITER_OBJECT);
+}
+
+int MJ_write_end_object(MJ_writer *w)
+{
+	assert(w != NULL);
+	return MJ_writer_end(w, '}', MJ_WRITER_OBJECT);
+}
+
+int MJ_write_key(MJ_writer *w, const char *key, size_t len)
+{
+	unsigned char *level;
+	assert(w != NULL);
+	if(w->error)
+		return w->error;
+	level = &w->levels[w->depth];
+	if((*level & (MJ_WRITER_OBJECT | MJ_WRITER_KEY)) != MJ_WRITER_OBJECT)
+		return w->error = MJ_WRITE_INVALID_STATE;
+	if((*level & MJ_WRITER_NONEMPTY) && MJ_writer_puts(w, ",", 1) != MJ_WRITE_OK)
+		return w->error;
+	*level |= MJ_WRITER_NONEMPTY | MJ_WRITER_KEY;
+	if(MJ_writer_string(w, key, len) != MJ_WRITE_OK)
+		return w->error;
+	return MJ_writer_puts(w, ":", 1);
+}
+
+int MJ_write_string(MJ_writer *w, const char *s, size_t len)
+{
+	assert(w != NULL);
+	if(MJ_writer_prefix(w) != MJ_WRITE_OK)
+		return w->error;
+	return MJ_writer_string(w, s, len);
+}
+
+int MJ_write_number(MJ_writer *w, double n)
+{
+	assert(w != NULL);
+	if(!w->error && !ISFINITE(n))
+		w->error = MJ_WRITE_INVALID_VALUE;
+	if(MJ_writer_prefix(w) != MJ_WRITE_OK || MJ_writer_reserve(w, 32) != MJ_WRITE_OK)
+		return w->error;
+	w->top += (size_t)sprintf(w->buffer + w->top, "%.17g", n);
+	return MJ_WRITE_OK;
+}
+
+int MJ_write_boolean(MJ_writer *w, int b)
+{
+	assert(w != NULL);
+	if(MJ_writer_prefix(w) != MJ_WRITE_OK)
+		return w->error;
+	return b ? MJ_writer_puts(w, "true", 4) : MJ_writer_puts(w, "false", 5);
+}
+
+int MJ_write_null(MJ_writer *w)
+{
+	assert(w != NULL);
+	if(MJ_writer_prefix(w) != MJ_WRITE_OK)
+		return w->error;
+	return MJ_writer_puts(w, "null", 4);
+}
+
+int MJ_write_value(MJ_writer *w, const MJ_value *v)
+{
+	size_t i;
+	assert(w != NULL && v != NULL);
+	switch(v->type)
+	{
+		case MJ_NULL:   return MJ_write_null(w);
+		case MJ_FALSE:  return MJ_write_boolean(w, 0);
+		case MJ_TRUE:   return MJ_write_boolean(w, 1);
+		case MJ_NUMBER: return MJ_write_number(w, v->u.n);
+		case MJ_STRING: return MJ_write_string(w, v->u.s.s, v->u.s.len);
+		case MJ_ARRAY:
+			MJ_write_begin_array(w);
+			for(i = 0; i < v->u.a.size && w->error == MJ_WRITE_OK; i++)
+				MJ_write_value(w, &v->u.a.e[i]);
+			return MJ_write_end_array(w);
+		case MJ_OBJECT:
+			MJ_write_begin_object(w);
+			for(i = 0; i < v->u.o.size && w->error == MJ_WRITE_OK; i++)
+			{
+				MJ_write_key(w, v->u.o.m[i].k, v->u.o.m[i].klen);
+				MJ_write_value(w, &v->u.o.m[i].v);
+			}
+			return MJ_write_end_object(w);
+		default:
+			assert(0 && "invalid type");
+			return w->error = MJ_WRITE_INVALID_STATE;
+	}
+}
+
+int MJ_writer_flush(MJ_writer *w)
+{
+	assert(w != NULL);
+	if(w->top > 0)
+		MJ_writer_emit(w, NULL, 0);
+	/* an open array or object, or no value at all, is not a JSON text */
+	if(!w->error && (w->depth != 0 || !(w->levels[0] & MJ_WRITER_NONEMPTY)))
+		return MJ_WRITE_INVALID_STATE;
+	return w->error;
+}
+
+/*
+*	binary: one tag byte per value, lengths and counts are varints so the
+*	decoder allocates every string, array and object at its final size.
+*	numbers are raw host-order doubles, or zigzag varints when integral.
+*/
+enum
+{
+	MJ_BINARY_NULL,
+	MJ_BINARY_FALSE,
+	MJ_BINARY_TRUE,
+	MJ_BINARY_DOUBLE,
+	MJ_BINARY_INTEGER,
+	MJ_BINARY_STRING,
+	MJ_BINARY_ARRAY,
+	MJ_BINARY_OBJECT
+};
+
+typedef struct
+{
+	const unsigned char *p, *end;
+}MJ_binary_context;
+
+static void MJ_encode_varint(MJ_context *c, size_t u)
+{
+	for(; u >= 0x80; u >>= 7)
+		PUTC(c, (char)(0x80 | (u & 0x7F)));
+	PUTC(c, (char)u);
+}
+
+static void MJ_encode_value(MJ_context *c, const MJ_value *v)
+{
+	static const double zero = 0.0;
+	size_t i;
+	long n;
+	switch(v->type)
+	{
+		case MJ_NULL:  PUTC(c, MJ_BINARY_NULL);  break;
+		case MJ_FALSE: PUTC(c, MJ_BINARY_FALSE); break;
+		case MJ_TRUE:  PUTC(c, MJ_BINARY_TRUE);  break;
+		case MJ_NUMBER:
+			/* 32 bit integers, but not -0 */
+			if(v->u.n >= -2147483648.0 && v->u.n <= 2147483647.0 && v->u.n == (double)(n = (long)v->u.n) &&
+				(n != 0 || memcmp(&v->u.n, &zero, sizeof(double)) == 0))
+			{
+				PUTC(c, MJ_BINARY_INTEGER);
+				MJ_encode_varint(c, n < 0 ? ((size_t)(-(n + 1)) << 1) | 1 : (size_t)n << 1);
+			}
+			else
+			{
+				PUTC(c, MJ_BINARY_DOUBLE);
+				PUTS(c, &v->u.n, sizeof(double));
+			}
+			break;
+		case MJ_STRING:
+			PUTC(c, MJ_BINARY_STRING);
+			MJ_encode_varint(c, v->u.s.len);
+			if(v->u.s.len > 0)
+				PUTS(c, v->u.s.s, v->u.s.len);
+			break;
+		case MJ_ARRAY:
+			PUTC(c, MJ_BINARY_ARRAY);
+			MJ_encode_varint(c, v->u.a.size);
+			for(i = 0; i < v->u.a.size; i++)
+				MJ_encode_value(c, &v->u.a.e[i]);
+			break;
+		case MJ_OBJECT:
+			PUTC(c, MJ_BINARY_OBJECT);
+			MJ_encode_varint(c, v->u.o.size);
+			for(i = 0; i < v->u.o.size; i++)
+			{
+				MJ_encode_varint(c, v->u.o.m[i].klen);
+				if(v->u.o.m[i].klen > 0)
+					PUTS(c, v->u.o.m[i].k, v->u.o.m[i].klen);
+				MJ_encode_value(c, &v->u.o.m[i].v);
+			}
+			break;
+		default: assert(0 && "invalid type");
+	}
+}
+
+char* MJ_encode_binary(const MJ_value *v, size_t *length)
+{
+	MJ_context c;
+	assert(v != NULL && length != NULL);
+	c.stack = (char*)malloc(c.size = MJ_PARSE_STRINGIFY_INIT_SIZE);
+	c.top = 0;
+	MJ_encode_value(&c, v);
+	*length = c.top;
+	return c.stack;
+}
+
+/* a count of at most min bytes each must fit in what is left */
+static int MJ_decode_varint(MJ_binary_context *c, size_t *u, size_t min)
+{
+	unsigned shift;
+	*u = 0;
+	for(shift = 0; c->p != c->end && shift < sizeof(size_t) * 8; shift += 7)
+	{
+		unsigned char ch = *c->p++;
+		*u |= (size_t)(ch & 0x7F) << shift;
+		if(!(ch & 0x80))
+			return min == 0 || *u <= (size_t)(c->end - c->p) / min;
+	}
+	return 0;
+}
+
+static int MJ_decode_value(MJ_binary_context *c, MJ_value *v)
+{
+	size_t i, size;
+	MJ_member *m;
+	int ret;
+	if(c->p == c->end)
+		return MJ_PARSE_INVALID_VALUE;
+	switch(*c->p++)
+	{
+		case MJ_BINARY_NULL:  v->type = MJ_NULL;  return MJ_PARSE_OK;
+		case MJ_BINARY_FALSE: v->type = MJ_FALSE; return MJ_PARSE_OK;
+		case MJ_BINARY_TRUE:  v->type = MJ_TRUE;  return MJ_PARSE_OK;
+		case MJ_BINARY_DOUBLE:
+			if((size_t)(c->end - c->p) < sizeof(double))
+				return MJ_PARSE_INVALID_VALUE;
+			memcpy(&v->u.n, c->p, sizeof(double));
+			c->p += sizeof(double);
+			v->type = MJ_NUMBER;
+			return MJ_PARSE_OK;
+		case MJ_BINARY_INTEGER:
+			if(!MJ_decode_varint(c, &size, 0) || size > 0xFFFFFFFFUL)
+				return MJ_PARSE_INVALID_VALUE;
+			v->u.n = (size & 1) ? -(double)(size >> 1) - 1.0 : (double)(size >> 1);
+			v->type = MJ_NUMBER;
+			return MJ_PARSE_OK;
+		case MJ_BINARY_STRING:
+			if(!MJ_decode_varint(c, &size, 1))
+				return MJ_PARSE_INVALID_VALUE;
+			MJ_set_string(v, (const char*)c->p, size);
+			c->p += size;
+			return MJ_PARSE_OK;
+		case MJ_BINARY_ARRAY:
+			if(!MJ_decode_varint(c, &size, 1))
+				return MJ_PARSE_INVALID_VALUE;
+			MJ_set_array(v, size);
+			for(i = 0; i < size; i++)
+			{
+				MJ_init(&v->u.a.e[i]);
+				v->u.a.size++;
+				if((ret = MJ_decode_value(c, &v->u.a.e[i])) != MJ_PARSE_OK)
+					return ret;
+			}
+			return MJ_PARSE_OK;
+		case MJ_BINARY_OBJECT:
+			if(!MJ_decode_varint(c, &size, 2))
+				return MJ_PARSE_INVALID_VALUE;
+			MJ_set_object(v, size);
+			for(i = 0; i < size; i++)
+			{
+				m = &v->u.o.m[i];
+				if(!MJ_decode_varint(c, &m->klen, 1))
+					return MJ_PARSE_INVALID_VALUE;
+				memcpy(m->k = (char*)malloc(m->klen + 1), c->p, m->klen);
+				m->k[m->klen] = '\0';
+				c->p += m->klen;
+				MJ_init(&m->v);
+				v->u.o.size++;
+				if((ret = MJ_decode_value(c, &m->v)) != MJ_PARSE_OK)
+					return ret;
+			}
+			return MJ_PARSE_OK;
+		default:
+			return MJ_PARSE_INVALID_VALUE;
+	}
+}
+
+int MJ_decode_binary(MJ_value *v, const char *data, size_t length)
+{
+	MJ_binary_context c;
+	int ret;
+	assert(v != NULL && (data != NULL || length == 0));
+	c.p = (const unsigned char*)data;
+	c.end = c.p + length;
+	MJ_init(v);
+	if((ret = MJ_decode_value(&c, v)) == MJ_PARSE_OK && c.p != c.end)
+		ret = MJ_PARSE_ROOT_NOT_SINGULAR;
+	if(ret != MJ_PARSE_OK)
+		MJ_free(v);
+	return ret;
+}
+
+void MJ_free(MJ_value *v)
+{
+	size_t i;
+	assert(v != NULL);
+	switch(v->type)
+	{
+		case MJ_STRING:
+			free(v->u.s.s);
+			break;
+		case MJ_ARRAY:
+			for(i = 0; i < v->u.a.size; i++)
+				MJ_free(&v->u.a.e[i]);
+			free(v->u.a.e);
+			break;
+		case MJ_OBJECT:
+			for(i = 0; i < v->u.o.size; i++)
+			{
+				free(v->u.o.m[i].k);
+				MJ_free(&v->u.o.m[i].v);
+			}
+			free(v->u.o.m);
+			break;
+		default:
+			break;
+	}
+	v->type = MJ_NULL;
+}
+
+/*
+*	every node of the copy gets one malloc of its final size,
+*	nothing is reallocated.
+*/
+static void MJ_copy_value(MJ_value *dst, const MJ_value *src)
+{
+	size_t i;
+	switch(src->type)
+	{
+		case MJ_STRING:
+			MJ_set_string(dst, src->u.s.s, src->u.s.len);
+			break;
+		case MJ_ARRAY:
+			MJ_set_array(dst, src->u.a.size);
+			for(i = 0; i < src->u.a.size; i++)
+			{
+				MJ_init(&dst->u.a.e[i]);
+				MJ_copy_value(&dst->u.a.e[i], &src->u.a.e[i]);
+			}
+			dst->u.a.size = src->u.a.size;
+			break;
+		case MJ_OBJECT:
+			MJ_set_object(dst, src->u.o.size);
+			for(i = 0; i < src->u.o.size; i++)
+			{
+				MJ_member *m = &dst->u.o.m[i];
+				m->klen = src->u.o.m[i].klen;
+				memcpy(m->k = (char*)malloc(m->klen + 1), src->u.o.m[i].k, m->klen + 1);
+				MJ_init(&m->v);
+				MJ_copy_value(&m->v, &src->u.o.m[i].v);
+			}
+			dst->u.o.size = src->u.o.size;
+			break;
+		default:
+			MJ_free(dst);
+			memcpy(dst, src, sizeof(MJ_value));
+			break;
+	}
+}
+
+void MJ_copy(MJ_value *dst, const MJ_value *src)
+{
+	MJ_value tmp;
+	assert(dst != NULL && src != NULL && dst != src);
+	/* src may live inside dst, build the copy before dst is freed */
+	MJ_init(&tmp);
+	MJ_copy_value(&tmp, src);
+	MJ_move(dst, &tmp);
+}
+
+void MJ_move(MJ_value *dst, MJ_value *src)
+{
+	MJ_value tmp;
+	assert(dst != NULL && src != NULL && dst != src);
+	/* src may live inside dst, detach it before dst is freed */
+	memcpy(&tmp, src, sizeof(MJ_value));
+	MJ_init(src);
+	MJ_free(dst);
+	memcpy(dst, &tmp, sizeof(MJ_value));
+}
+
+void MJ_swap(MJ_value *lhs, MJ_value *rhs)
+{
+	assert(lhs != NULL && rhs != NULL);
+	if(lhs != rhs)
+	{
+		MJ_value temp;
+		memcpy(&temp, lhs, sizeof(MJ_value));
+		memcpy(lhs, rhs, sizeof(MJ_value));
+		memcpy(rhs, &temp, sizeof(MJ_value));
+	}
+}
+
+static int MJ_is_equal_member(const MJ_member *lhs, const MJ_member *rhs)
+{
+	return lhs->klen == rhs->klen && memcmp(lhs->k, rhs->k, lhs->klen) == 0 && MJ_is_equal(&lhs->v, &rhs->v);
+}
+
+/*
+*	members from begin on, in any order: each one of lhs needs its own equal
+*	member in rhs, so duplicate keys compare the same both ways round.
+*/
+static int MJ_is_equal_unordered(const MJ_value *lhs, const MJ_value *rhs, size_t begin)
+{
+	size_t n = lhs->u.o.size - begin, i, j;
+	char *used = (char*)calloc(n, 1);
+	for(i = 0; i < n; i++)
+	{
+		for(j = 0; j < n && (used[j] || !MJ_is_equal_member(&lhs->u.o.m[begin + i], &rhs->u.o.m[begin + j])); j++);
+		if(j == n)
+			break;
+		used[j] = 1;
+	}
+	free(used);
+	return i == n;
+}
+
+int MJ_is_equal(const MJ_value *lhs, const MJ_value *rhs)
+{
+	size_t i;
+	assert(lhs != NULL && rhs != NULL);
+	if(lhs == rhs)
+		return 1;
+	if(lhs->type != rhs->type)
+		return 0;
+	switch(lhs->type)
+	{
+		case MJ_STRING:
+			return lhs->u.s.len == rhs->u.s.len &&
+				memcmp(lhs->u.s.s, rhs->u.s.s, lhs->u.s.len) == 0;
+		case MJ_NUMBER:
+			return lhs->u.n == rhs->u.n;
+		case MJ_ARRAY:
+			if(lhs->u.a.size != rhs->u.a.size)
+				return 0;
+			for(i = 0; i < lhs->u.a.size; i++)
+				if(!MJ_is_equal(&lhs->u.a.e[i], &rhs->u.a.e[i]))
+					return 0;
+			return 1;
+		case MJ_OBJECT:
+			if(lhs->u.o.size != rhs->u.o.size)
+				return 0;
+			for(i = 0; i < lhs->u.o.size && MJ_is_equal_member(&lhs->u.o.m[i], &rhs->u.o.m[i]); i++);
+			return i == lhs->u.o.size || MJ_is_equal_unordered(lhs, rhs, i);
+		default:
+			return 1;
+	}
+}
+
+MJ_type MJ_get_type(const MJ_value *v)
+{
+	assert(v != NULL);
+	return v->type;
+}
+
+int MJ_get_boolean(const MJ_value *v) 
+{
+    assert(v != NULL && (v->type == MJ_TRUE || v->type == MJ_FALSE));
+    return v->type == MJ_TRUE;
+}
+
+void MJ_set_boolean(MJ_value *v, int b) 
+{
+    MJ_free(v);
+    v->type = b ? MJ_TRUE : MJ_FALSE;
+}
+
+void MJ_set_number(MJ_value *v, double n) 
+{
+    MJ_free(v);
+    v->u.n = n;
+    v->type = MJ_NUMBER;
+}
+
+double MJ_get_number(const MJ_value *v)
+{
+	assert(v != NULL && v->type == MJ_NUMBER);
+	return v->u.n;
+}
+
+const char* MJ_get_string(const MJ_value *v) 
+{
+    assert(v != NULL && v->type == MJ_STRING);
+    return v->u.s.s;
+}
+
+size_t MJ_get_string_length(const MJ_value *v) 
 {
     assert(v != NULL && v->type == MJ_STRING);
     return v->u.s.len;
@@ -429,3 +1771,695 @@ MJ_value* MJ_get_array_element(const MJ_value* v, size_t index)
     assert(index < v->u.a.size);
     return &v->u.a.e[index];
 }
+
+void MJ_set_array(MJ_value *v, size_t capacity)
+{
+	assert(v != NULL);
+	MJ_free(v);
+	v->type = MJ_ARRAY;
+	v->u.a.size = 0;
+	v->u.a.capacity = capacity;
+	v->u.a.e = capacity > 0 ? (MJ_value*)malloc(capacity * sizeof(MJ_value)) : NULL;
+}
+
+size_t MJ_get_array_capacity(const MJ_value *v)
+{
+	assert(v != NULL && v->type == MJ_ARRAY);
+	return v->u.a.capacity;
+}
+
+void MJ_reserve_array(MJ_value *v, size_t capacity)
+{
+	assert(v != NULL && v->type == MJ_ARRAY);
+	if(v->u.a.capacity < capacity)
+	{
+		v->u.a.capacity = capacity;
+		v->u.a.e = (MJ_value*)realloc(v->u.a.e, capacity * sizeof(MJ_value));
+	}
+}
+
+void MJ_shrink_array(MJ_value *v)
+{
+	assert(v != NULL && v->type == MJ_ARRAY);
+	if(v->u.a.capacity > v->u.a.size)
+	{
+		v->u.a.capacity = v->u.a.size;
+		if(v->u.a.size == 0)
+		{
+			free(v->u.a.e);
+			v->u.a.e = NULL;
+		}
+		else
+			v->u.a.e = (MJ_value*)realloc(v->u.a.e, v->u.a.size * sizeof(MJ_value));
+	}
+}
+
+void MJ_clear_array(MJ_value *v)
+{
+	size_t i;
+	assert(v != NULL && v->type == MJ_ARRAY);
+	for(i = 0; i < v->u.a.size; i++)
+		MJ_free(&v->u.a.e[i]);
+	v->u.a.size = 0;
+}
+
+MJ_value* MJ_pushback_array_element(MJ_value *v)
+{
+	assert(v != NULL && v->type == MJ_ARRAY);
+	if(v->u.a.size == v->u.a.capacity)
+		MJ_reserve_array(v, v->u.a.capacity == 0 ? 1 : v->u.a.capacity * 2);
+	MJ_init(&v->u.a.e[v->u.a.size]);
+	return &v->u.a.e[v->u.a.size++];
+}
+
+void MJ_popback_array_element(MJ_value *v)
+{
+	assert(v != NULL && v->type == MJ_ARRAY && v->u.a.size > 0);
+	MJ_free(&v->u.a.e[--v->u.a.size]);
+}
+
+MJ_value* MJ_insert_array_element(MJ_value *v, size_t index)
+{
+	assert(v != NULL && v->type == MJ_ARRAY && index <= v->u.a.size);
+	if(v->u.a.size == v->u.a.capacity)
+		MJ_reserve_array(v, v->u.a.capacity == 0 ? 1 : v->u.a.capacity * 2);
+	memmove(&v->u.a.e[index + 1], &v->u.a.e[index], (v->u.a.size - index) * sizeof(MJ_value));
+	v->u.a.size++;
+	MJ_init(&v->u.a.e[index]);
+	return &v->u.a.e[index];
+}
+
+void MJ_erase_array_element(MJ_value *v, size_t index, size_t count)
+{
+	size_t i;
+	assert(v != NULL && v->type == MJ_ARRAY && index + count <= v->u.a.size);
+	for(i = index; i < index + count; i++)
+		MJ_free(&v->u.a.e[i]);
+	memmove(&v->u.a.e[index], &v->u.a.e[index + count], (v->u.a.size - index - count) * sizeof(MJ_value));
+	v->u.a.size -= count;
+}
+
+void MJ_set_object(MJ_value *v, size_t capacity)
+{
+	assert(v != NULL);
+	MJ_free(v);
+	v->type = MJ_OBJECT;
+	v->u.o.size = 0;
+	v->u.o.capacity = capacity;
+	v->u.o.m = capacity > 0 ? (MJ_member*)malloc(capacity * sizeof(MJ_member)) : NULL;
+}
+
+size_t MJ_get_object_size(const MJ_value *v)
+{
+	assert(v != NULL && v->type == MJ_OBJECT);
+	return v->u.o.size;
+}
+
+size_t MJ_get_object_capacity(const MJ_value *v)
+{
+	assert(v != NULL && v->type == MJ_OBJECT);
+	return v->u.o.capacity;
+}
+
+void MJ_reserve_object(MJ_value *v, size_t capacity)
+{
+	assert(v != NULL && v->type == MJ_OBJECT);
+	if(v->u.o.capacity < capacity)
+	{
+		v->u.o.capacity = capacity;
+		v->u.o.m = (MJ_member*)realloc(v->u.o.m, capacity * sizeof(MJ_member));
+	}
+}
+
+void MJ_shrink_object(MJ_value *v)
+{
+	assert(v != NULL && v->type == MJ_OBJECT);
+	if(v->u.o.capacity > v->u.o.size)
+	{
+		v->u.o.capacity = v->u.o.size;
+		if(v->u.o.size == 0)
+		{
+			free(v->u.o.m);
+			v->u.o.m = NULL;
+		}
+		else
+			v->u.o.m = (MJ_member*)realloc(v->u.o.m, v->u.o.size * sizeof(MJ_member));
+	}
+}
+
+void MJ_clear_object(MJ_value *v)
+{
+	size_t i;
+	assert(v != NULL && v->type == MJ_OBJECT);
+	for(i = 0; i < v->u.o.size; i++)
+	{
+		free(v->u.o.m[i].k);
+		MJ_free(&v->u.o.m[i].v);
+	}
+	v->u.o.size = 0;
+}
+
+const char* MJ_get_object_key(const MJ_value *v, size_t index)
+{
+	assert(v != NULL && v->type == MJ_OBJECT);
+	assert(index < v->u.o.size);
+	return v->u.o.m[index].k;
+}
+
+size_t MJ_get_object_key_length(const MJ_value *v, size_t index)
+{
+	assert(v != NULL && v->type == MJ_OBJECT);
+	assert(index < v->u.o.size);
+	return v->u.o.m[index].klen;
+}
+
+MJ_value* MJ_get_object_value(const MJ_value *v, size_t index)
+{
+	assert(v != NULL && v->type == MJ_OBJECT);
+	assert(index < v->u.o.size);
+	return &v->u.o.m[index].v;
+}
+
+size_t MJ_find_object_index(const MJ_value *v, const char *key, size_t klen)
+{
+	size_t i;
+	assert(v != NULL && v->type == MJ_OBJECT && (key != NULL || klen == 0));
+	for(i = 0; i < v->u.o.size; i++)
+		if(v->u.o.m[i].klen == klen && memcmp(v->u.o.m[i].k, key, klen) == 0)
+			return i;
+	return MJ_KEY_NOT_EXIST;
+}
+
+MJ_value* MJ_find_object_value(const MJ_value *v, const char *key, size_t klen)
+{
+	size_t index = MJ_find_object_index(v, key, klen);
+	return index != MJ_KEY_NOT_EXIST ? &v->u.o.m[index].v : NULL;
+}
+
+MJ_value* MJ_set_object_value(MJ_value *v, const char *key, size_t klen)
+{
+	MJ_member *m;
+	size_t index = MJ_find_object_index(v, key, klen);
+	if(index != MJ_KEY_NOT_EXIST)
+		return &v->u.o.m[index].v;
+	if(v->u.o.size == v->u.o.capacity)
+		MJ_reserve_object(v, v->u.o.capacity == 0 ? 1 : v->u.o.capacity * 2);
+	m = &v->u.o.m[v->u.o.size++];
+	m->klen = klen;
+	m->k = (char*)malloc(klen + 1);
+	memcpy(m->k, key, klen);
+	m->k[klen] = '\0';
+	MJ_init(&m->v);
+	return &m->v;
+}
+
+void MJ_remove_object_value(MJ_value *v, size_t index)
+{
+	assert(v != NULL && v->type == MJ_OBJECT && index < v->u.o.size);
+	free(v->u.o.m[index].k);
+	MJ_free(&v->u.o.m[index].v);
+	memmove(&v->u.o.m[index], &v->u.o.m[index + 1], (v->u.o.size - index - 1) * sizeof(MJ_member));
+	v->u.o.size--;
+}
+
+/*
+*	patch: JSON Pointer (RFC 6901) tokens are decoded in place inside the
+*	patch's own path strings, so resolving a path allocates nothing.
+*/
+#define STRING_IS(v, lit)	((v)->u.s.len == sizeof(lit) - 1 && memcmp((v)->u.s.s, lit, sizeof(lit) - 1) == 0)
+
+static int MJ_pointer_token(char **p, const char *end, char **token, size_t *len)
+{
+	char *r = *p, *w = *p;
+	for(*token = *p; r != end && *r != '/'; r++)
+	{
+		if(*r == '~')
+		{
+			if(r + 1 == end || (r[1] != '0' && r[1] != '1'))
+				return 0;
+			*w++ = *++r == '0' ? '~' : '/';
+		}
+		else
+			*w++ = *r;
+	}
+	*len = (size_t)(w - *token);
+	*p = r;
+	return 1;
+}
+
+/* "-" is one past the last element, otherwise digits without leading zeros */
+static size_t MJ_pointer_index(const MJ_value *a, const char *token, size_t len)
+{
+	size_t i, index = 0;
+	if(len == 1 && token[0] == '-')
+		return a->u.a.size;
+	if(len == 0 || (token[0] == '0' && len > 1))
+		return MJ_KEY_NOT_EXIST;
+	for(i = 0; i < len; i++)
+	{
+		if(!ISDIGIT(token[i]) || index > a->u.a.size)
+			return MJ_KEY_NOT_EXIST;
+		index = index * 10 + (token[i] - '0');
+	}
+	return index;
+}
+
+static MJ_value* MJ_pointer_child(MJ_value *v, const char *token, size_t len)
+{
+	size_t index;
+	if(v->type == MJ_OBJECT)
+		return MJ_find_object_value(v, token, len);
+	if(v->type == MJ_ARRAY && (index = MJ_pointer_index(v, token, len)) < v->u.a.size)
+		return &v->u.a.e[index];
+	return NULL;
+}
+
+/* walk path up to its last token, the root path "" gives v with *token == NULL */
+static MJ_value* MJ_pointer_parent(MJ_value *v, MJ_value *path, char **token, size_t *len)
+{
+	char *p = path->u.s.s;
+	const char *end = p + path->u.s.len;
+	*token = NULL;
+	if(p == end)
+		return v;
+	if(*p != '/')
+		return NULL;
+	while(1)
+	{
+		p++;
+		if(!MJ_pointer_token(&p, end, token, len))
+			return NULL;
+		if(p == end)
+			return v;
+		if((v = MJ_pointer_child(v, *token, *len)) == NULL)
+			return NULL;
+	}
+}
+
+static MJ_value* MJ_pointer_get(MJ_value *v, MJ_value *path)
+{
+	char *token;
+	size_t len;
+	if((v = MJ_pointer_parent(v, path, &token, &len)) == NULL || token == NULL)
+		return v;
+	return MJ_pointer_child(v, token, len);
+}
+
+static int MJ_patch_add(MJ_value *v, MJ_value *path, MJ_value *value)
+{
+	char *token;
+	size_t len, index;
+	if((v = MJ_pointer_parent(v, path, &token, &len)) == NULL)
+		return MJ_PATCH_PATH_NOT_FOUND;
+	if(token == NULL)
+		MJ_move(v, value);
+	else if(v->type == MJ_OBJECT)
+		MJ_move(MJ_set_object_value(v, token, len), value);
+	else if(v->type == MJ_ARRAY && (index = MJ_pointer_index(v, token, len)) <= v->u.a.size)
+		MJ_move(MJ_insert_array_element(v, index), value);
+	else
+		return MJ_PATCH_PATH_NOT_FOUND;
+	return MJ_PATCH_OK;
+}
+
+/* the removed value is moved to out */
+static int MJ_patch_remove(MJ_value *v, MJ_value *path, MJ_value *out)
+{
+	char *token;
+	size_t len, index;
+	if((v = MJ_pointer_parent(v, path, &token, &len)) == NULL || token == NULL)
+		return MJ_PATCH_PATH_NOT_FOUND;
+	if(v->type == MJ_OBJECT && (index = MJ_find_object_index(v, token, len)) != MJ_KEY_NOT_EXIST)
+	{
+		MJ_move(out, &v->u.o.m[index].v);
+		MJ_remove_object_value(v, index);
+	}
+	else if(v->type == MJ_ARRAY && (index = MJ_pointer_index(v, token, len)) < v->u.a.size)
+	{
+		MJ_move(out, &v->u.a.e[index]);
+		MJ_erase_array_element(v, index, 1);
+	}
+	else
+		return MJ_PATCH_PATH_NOT_FOUND;
+	return MJ_PATCH_OK;
+}
+
+/* the value at from is detached, and put back at the same place if path cannot take it */
+static int MJ_patch_move(MJ_value *v, MJ_value *from, MJ_value *path)
+{
+	MJ_value *parent, temp;
+	MJ_member m;
+	char *token;
+	size_t len, index;
+	int ret;
+	if((parent = MJ_pointer_parent(v, from, &token, &len)) == NULL || token == NULL)
+		return MJ_PATCH_PATH_NOT_FOUND;
+	if(parent->type == MJ_OBJECT && (index = MJ_find_object_index(parent, token, len)) != MJ_KEY_NOT_EXIST)
+	{
+		m = parent->u.o.m[index];
+		memmove(&parent->u.o.m[index], &parent->u.o.m[index + 1], (parent->u.o.size - index - 1) * sizeof(MJ_member));
+		parent->u.o.size--;
+		if((ret = MJ_patch_add(v, path, &m.v)) == MJ_PATCH_OK)
+		{
+			free(m.k);
+			return ret;
+		}
+		memmove(&parent->u.o.m[index + 1], &parent->u.o.m[index], (parent->u.o.size - index) * sizeof(MJ_member));
+		parent->u.o.m[index] = m;
+		parent->u.o.size++;
+		return ret;
+	}
+	if(parent->type == MJ_ARRAY && (index = MJ_pointer_index(parent, token, len)) < parent->u.a.size)
+	{
+		MJ_init(&temp);
+		MJ_move(&temp, &parent->u.a.e[index]);
+		MJ_erase_array_element(parent, index, 1);
+		if((ret = MJ_patch_add(v, path, &temp)) != MJ_PATCH_OK)
+			MJ_move(MJ_insert_array_element(parent, index), &temp);
+		return ret;
+	}
+	return MJ_PATCH_PATH_NOT_FOUND;
+}
+
+static int MJ_patch_operation(MJ_value *v, MJ_value *op)
+{
+	MJ_value *name, *path, *from, *value, *target, temp;
+	int ret = MJ_PATCH_OK;
+	if(op->type != MJ_OBJECT ||
+		(name = MJ_find_object_value(op, "op", 2)) == NULL || name->type != MJ_STRING ||
+		(path = MJ_find_object_value(op, "path", 4)) == NULL || path->type != MJ_STRING)
+		return MJ_PATCH_INVALID_OPERATION;
+	if((from = MJ_find_object_value(op, "from", 4)) != NULL && from->type != MJ_STRING)
+		return MJ_PATCH_INVALID_OPERATION;
+	value = MJ_find_object_value(op, "value", 5);
+	MJ_init(&temp);
+	if(STRING_IS(name, "add"))
+		ret = value == NULL ? MJ_PATCH_INVALID_OPERATION : MJ_patch_add(v, path, value);
+	else if(STRING_IS(name, "remove"))
+		ret = MJ_patch_remove(v, path, &temp);
+	else if(STRING_IS(name, "replace"))
+	{
+		if(value == NULL)
+			ret = MJ_PATCH_INVALID_OPERATION;
+		else if((target = MJ_pointer_get(v, path)) == NULL)
+			ret = MJ_PATCH_PATH_NOT_FOUND;
+		else
+			MJ_move(target, value);
+	}
+	else if(STRING_IS(name, "move"))
+	{
+		/* a value cannot be moved into one of its own children */
+		if(from == NULL || (from->u.s.len < path->u.s.len && path->u.s.s[from->u.s.len] == '/' &&
+			memcmp(from->u.s.s, path->u.s.s, from->u.s.len) == 0))
+			ret = MJ_PATCH_INVALID_OPERATION;
+		else
+			ret = MJ_patch_move(v, from, path);
+	}
+	else if(STRING_IS(name, "copy"))
+	{
+		if(from == NULL)
+			ret = MJ_PATCH_INVALID_OPERATION;
+		else if((target = MJ_pointer_get(v, from)) == NULL)
+			ret = MJ_PATCH_PATH_NOT_FOUND;
+		else
+		{
+			MJ_copy(&temp, target);
+			ret = MJ_patch_add(v, path, &temp);
+		}
+	}
+	else if(STRING_IS(name, "test"))
+	{
+		if(value == NULL)
+			ret = MJ_PATCH_INVALID_OPERATION;
+		else if((target = MJ_pointer_get(v, path)) == NULL)
+			ret = MJ_PATCH_PATH_NOT_FOUND;
+		else if(!MJ_is_equal(target, value))
+			ret = MJ_PATCH_TEST_FAILED;
+	}
+	else
+		ret = MJ_PATCH_INVALID_OPERATION;
+	MJ_free(&temp);
+	return ret;
+}
+
+int MJ_apply_patch(MJ_value *v, MJ_value *patch)
+{
+	size_t i;
+	int ret = MJ_PATCH_OK;
+	assert(v != NULL && patch != NULL && v != patch);
+	if(patch->type != MJ_ARRAY)
+		ret = MJ_PATCH_INVALID_OPERATION;
+	for(i = 0; ret == MJ_PATCH_OK && i < patch->u.a.size; i++)
+		ret = MJ_patch_operation(v, &patch->u.a.e[i]);
+	MJ_free(patch);
+	return ret;
+}
+
+void MJ_merge_patch(MJ_value *v, MJ_value *patch)
+{
+	size_t i, index;
+	assert(v != NULL && patch != NULL && v != patch);
+	if(patch->type != MJ_OBJECT)
+	{
+		MJ_move(v, patch);
+		return;
+	}
+	if(v->type != MJ_OBJECT)
+		MJ_set_object(v, patch->u.o.size);
+	for(i = 0; i < patch->u.o.size; i++)
+	{
+		MJ_member *m = &patch->u.o.m[i];
+		if(m->v.type == MJ_NULL)
+		{
+			if((index = MJ_find_object_index(v, m->k, m->klen)) != MJ_KEY_NOT_EXIST)
+				MJ_remove_object_value(v, index);
+		}
+		else
+			MJ_merge_patch(MJ_set_object_value(v, m->k, m->klen), &m->v);
+	}
+	MJ_free(patch);
+}
+
+/*
+*	document: a frozen tree shared between threads. readers take a
+*	reference with MJ_shared_acquire() without locking, writers swap
+*	in a new version and the last reference hands the old tree to a
+*	background thread, which frees it off the readers' path.
+*/
+#ifdef MJ_ENABLE_THREADS
+#define ATOMIC_LOAD(p)			__atomic_load_n(p, __ATOMIC_SEQ_CST)
+#define ATOMIC_STORE(p, x)		__atomic_store_n(p, x, __ATOMIC_SEQ_CST)
+#define ATOMIC_EXCHANGE(p, x)	__atomic_exchange_n(p, x, __ATOMIC_SEQ_CST)
+#define ATOMIC_ADD(p, x)		__atomic_add_fetch(p, x, __ATOMIC_SEQ_CST)
+#define ATOMIC_SUB(p, x)		__atomic_sub_fetch(p, x, __ATOMIC_SEQ_CST)
+#else
+#define ATOMIC_LOAD(p)			(*(p))
+#define ATOMIC_STORE(p, x)		(*(p) = (x))
+#define ATOMIC_EXCHANGE(p, x)	MJ_exchange_document(p, x)
+#define ATOMIC_ADD(p, x)		(*(p) += (x))
+#define ATOMIC_SUB(p, x)		(*(p) -= (x))
+#endif
+
+struct MJ_document
+{
+	MJ_value v;
+	MJ_document *next;		/* reclaim queue */
+	char pad[MJ_CACHE_LINE_SIZE];	/* keeps refs off the line readers read the root from */
+	unsigned long refs;
+};
+
+typedef struct
+{
+	unsigned long n;
+	char pad[MJ_CACHE_LINE_SIZE - sizeof(unsigned long)];
+}MJ_shared_counter;
+
+struct MJ_shared
+{
+	MJ_document *current;
+	unsigned long epoch;
+	char pad[MJ_CACHE_LINE_SIZE];
+	MJ_shared_counter readers[2];	/* readers taking a reference, by epoch parity, a line each */
+#ifdef MJ_ENABLE_THREADS
+	pthread_mutex_t lock;		/* one writer at a time */
+#endif
+};
+
+#ifdef MJ_ENABLE_THREADS
+static pthread_once_t MJ_reclaim_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t MJ_reclaim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t MJ_reclaim_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t MJ_reclaim_done = PTHREAD_COND_INITIALIZER;
+static MJ_document *MJ_reclaim_queue = NULL;
+static int MJ_reclaim_busy = 0, MJ_reclaim_started = 0;
+
+static void* MJ_reclaim_worker(void *arg)
+{
+	MJ_document *d, *next;
+	(void)arg;
+	pthread_mutex_lock(&MJ_reclaim_lock);
+	while(1)
+	{
+		while(MJ_reclaim_queue == NULL)
+			pthread_cond_wait(&MJ_reclaim_ready, &MJ_reclaim_lock);
+		d = MJ_reclaim_queue;
+		MJ_reclaim_queue = NULL;
+		MJ_reclaim_busy = 1;
+		pthread_mutex_unlock(&MJ_reclaim_lock);
+		for(; d != NULL; d = next)
+		{
+			next = d->next;
+			MJ_free(&d->v);
+			free(d);
+		}
+		pthread_mutex_lock(&MJ_reclaim_lock);
+		MJ_reclaim_busy = 0;
+		pthread_cond_broadcast(&MJ_reclaim_done);
+	}
+	return NULL;
+}
+
+static void MJ_reclaim_start(void)
+{
+	pthread_t tid;
+	if(pthread_create(&tid, NULL, MJ_reclaim_worker, NULL) == 0)
+	{
+		pthread_detach(tid);
+		MJ_reclaim_started = 1;
+	}
+}
+#else
+static MJ_document* MJ_exchange_document(MJ_document **p, MJ_document *d)
+{
+	MJ_document *old = *p;
+	*p = d;
+	return old;
+}
+#endif
+
+static void MJ_reclaim(MJ_document *d)
+{
+#ifdef MJ_ENABLE_THREADS
+	pthread_once(&MJ_reclaim_once, MJ_reclaim_start);
+	if(MJ_reclaim_started)
+	{
+		pthread_mutex_lock(&MJ_reclaim_lock);
+		d->next = MJ_reclaim_queue;
+		MJ_reclaim_queue = d;
+		pthread_cond_signal(&MJ_reclaim_ready);
+		pthread_mutex_unlock(&MJ_reclaim_lock);
+		return;
+	}
+#endif
+	MJ_free(&d->v);
+	free(d);
+}
+
+void MJ_reclaim_wait(void)
+{
+#ifdef MJ_ENABLE_THREADS
+	pthread_mutex_lock(&MJ_reclaim_lock);
+	while(MJ_reclaim_queue != NULL || MJ_reclaim_busy)
+		pthread_cond_wait(&MJ_reclaim_done, &MJ_reclaim_lock);
+	pthread_mutex_unlock(&MJ_reclaim_lock);
+#endif
+}
+
+MJ_document* MJ_freeze(MJ_value *v)
+{
+	MJ_document *d;
+	assert(v != NULL);
+	d = (MJ_document*)malloc(sizeof(MJ_document));
+	MJ_init(&d->v);
+	MJ_move(&d->v, v);
+	d->refs = 1;
+	d->next = NULL;
+	return d;
+}
+
+const MJ_value* MJ_document_root(const MJ_document *d)
+{
+	assert(d != NULL);
+	return &d->v;
+}
+
+void MJ_document_retain(MJ_document *d)
+{
+	assert(d != NULL);
+	ATOMIC_ADD(&d->refs, 1);
+}
+
+void MJ_document_release(MJ_document *d)
+{
+	if(d != NULL && ATOMIC_SUB(&d->refs, 1) == 0)
+		MJ_reclaim(d);
+}
+
+MJ_shared* MJ_shared_create(MJ_document *d)
+{
+	MJ_shared *s;
+	assert(d != NULL);
+	s = (MJ_shared*)malloc(sizeof(MJ_shared));
+	s->current = d;
+	s->epoch = 0;
+	s->readers[0].n = s->readers[1].n = 0;
+#ifdef MJ_ENABLE_THREADS
+	pthread_mutex_init(&s->lock, NULL);
+#endif
+	return s;
+}
+
+MJ_document* MJ_shared_acquire(MJ_shared *s)
+{
+	MJ_document *d;
+	unsigned long *readers;
+	assert(s != NULL);
+	readers = &s->readers[ATOMIC_LOAD(&s->epoch) & 1].n;
+	ATOMIC_ADD(readers, 1);
+	d = ATOMIC_LOAD(&s->current);
+	ATOMIC_ADD(&d->refs, 1);
+	ATOMIC_SUB(readers, 1);
+	return d;
+}
+
+void MJ_shared_swap(MJ_shared *s, MJ_document *d)
+{
+	MJ_document *old;
+	unsigned long epoch;
+	int i;
+	assert(s != NULL && d != NULL);
+#ifdef MJ_ENABLE_THREADS
+	pthread_mutex_lock(&s->lock);
+#endif
+	old = ATOMIC_EXCHANGE(&s->current, d);
+	/*
+	*	a reader may have loaded old but not yet taken its reference, it is
+	*	counted in one of the two counters. flipping the epoch sends new
+	*	readers to the other counter, so the one waited on only drains.
+	*/
+	for(i = 0; i < 2; i++)
+	{
+		epoch = s->epoch;
+		ATOMIC_STORE(&s->epoch, epoch + 1);
+		while(ATOMIC_LOAD(&s->readers[epoch & 1].n) != 0)
+#ifdef MJ_ENABLE_THREADS
+			sched_yield();
+#else
+			;
+#endif
+	}
+#ifdef MJ_ENABLE_THREADS
+	pthread_mutex_unlock(&s->lock);
+#endif
+	MJ_document_release(old);
+}
+
+void MJ_shared_destroy(MJ_shared *s)
+{
+	assert(s != NULL);
+	MJ_document_release(s->current);
+#ifdef MJ_ENABLE_THREADS
+	pthread_mutex_destroy(&s->lock);
+#endif
+	free(s);
+}
\ No newline at end of file
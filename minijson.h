@@ -1,7 +1,7 @@
 #ifndef MINIJSON_H
 #define MINIJSON_H
 
-#include <stddef.h> /* size_t */
+#include <stddef.h> /* size_t, offsetof() */
 
 typedef enum 
 {
@@ -15,15 +15,21 @@ typedef enum
 }MJ_type;
 
 typedef struct MJ_value MJ_value;
+typedef struct MJ_member MJ_member;
 
-typedef struct MJ_value
+struct MJ_value
 {
 	union
 	{
+		struct
+		{
+			MJ_member *m;
+			size_t size, capacity;
+		}o;					/* object */
 		struct
 		{
 			MJ_value *e;
-			size_t size;
+			size_t size, capacity;
 		}a;					/* array */
 		struct
 		{
@@ -35,6 +41,13 @@ typedef struct MJ_value
 	MJ_type type;
 };
 
+struct MJ_member
+{
+	char *k;
+	size_t klen;	/* member key string, key string length */
+	MJ_value v;		/* member value */
+};
+
 enum
 {
 	MJ_PARSE_OK = 0,
@@ -47,15 +60,116 @@ enum
 	MJ_PARSE_INVALID_STRING_CHAR,
 	MJ_PARSE_INVALID_UNICODE_HEX,
     MJ_PARSE_INVALID_UNICODE_SURROGATE,
-    MJ_PARSE_MISS_COMMA_OR_SQUARE_BRACKET
+    MJ_PARSE_MISS_COMMA_OR_SQUARE_BRACKET,
+    MJ_PARSE_MISS_KEY,
+    MJ_PARSE_MISS_COLON,
+    MJ_PARSE_MISS_COMMA_OR_CURLY_BRACKET,
+    MJ_PARSE_MISS_REQUIRED_FIELD,
+    MJ_PARSE_FIELD_MISMATCH
 };
 
 #define MJ_init(v) do { (v)->type = MJ_NULL; } while(0)
 
 int MJ_parse(MJ_value *v, const char *json);
 
+/* specializations for MJ_parse_flags(), each one is a separately compiled parser */
+enum
+{
+	MJ_PARSE_DEFAULT = 0,
+	MJ_PARSE_TRUSTED = 1 << 0,		/* well-formed input: no control char or number grammar checks */
+	MJ_PARSE_INTEGER_ONLY = 1 << 1	/* numbers have no fraction or exponent, strtod() only past 15 digits */
+};
+
+int MJ_parse_flags(MJ_value *v, const char *json, unsigned flags);
+
+/*
+*	validate-only: check the whole input is one well-formed JSON value.
+*	nothing is allocated, escapes are not decoded and numbers are not
+*	converted, so a number out of double range is not an error here.
+*/
+int MJ_validate(const char *json);
+/* skip leading whitespace and one value, *end is the offset just past it */
+int MJ_skip(const char *json, size_t *end);
+
+/* NaN and infinite numbers are written as null */
+char* MJ_stringify(const MJ_value *v, size_t *length);
+/*
+*	same bytes as MJ_stringify(), every array or object, at any depth, with
+*	enough elements is split across up to threads threads (needs MJ_ENABLE_THREADS)
+*/
+char* MJ_stringify_parallel(const MJ_value *v, size_t *length, unsigned threads);
+
+/*
+*	streaming writer: JSON is escaped into a fixed buffer inside MJ_writer
+*	and flushed to a callback or a file descriptor, no tree is built.
+*	the buffer and depth limits must be the same for the library and its users.
+*/
+#ifndef MJ_WRITER_BUFFER_SIZE
+#define MJ_WRITER_BUFFER_SIZE 4096
+#endif
+#ifndef MJ_WRITER_MAX_DEPTH
+#define MJ_WRITER_MAX_DEPTH 64
+#endif
+
+enum
+{
+	MJ_WRITE_OK = 0,
+	MJ_WRITE_IO_ERROR,
+	MJ_WRITE_INVALID_STATE,
+	MJ_WRITE_TOO_DEEP,
+	MJ_WRITE_INVALID_VALUE	/* a NaN or infinite number */
+};
+
+/* returns 0 when all len bytes were written */
+typedef int (*MJ_write_func)(void *user, const char *data, size_t len);
+
+typedef struct
+{
+	MJ_write_func write;
+	void *user;
+	int fd;
+	int error;		/* sticky, the first MJ_WRITE_* error */
+	size_t top;
+	unsigned depth;
+	unsigned char levels[MJ_WRITER_MAX_DEPTH];
+	char buffer[MJ_WRITER_BUFFER_SIZE];
+}MJ_writer;
+
+void MJ_writer_init(MJ_writer *w, MJ_write_func func, void *user);
+#ifndef _WIN32
+/* large strings are written with writev() straight from the caller's memory */
+void MJ_writer_init_fd(MJ_writer *w, int fd);
+#endif
+int MJ_write_begin_array(MJ_writer *w);
+int MJ_write_end_array(MJ_writer *w);
+int MJ_write_begin_object(MJ_writer *w);
+int MJ_write_end_object(MJ_writer *w);
+int MJ_write_key(MJ_writer *w, const char *key, size_t len);
+int MJ_write_string(MJ_writer *w, const char *s, size_t len);
+int MJ_write_number(MJ_writer *w, double n);
+int MJ_write_boolean(MJ_writer *w, int b);
+int MJ_write_null(MJ_writer *w);
+int MJ_write_value(MJ_writer *w, const MJ_value *v);
+/* must be called at the end, returns the sticky error, or MJ_WRITE_INVALID_STATE if the value is unfinished */
+int MJ_writer_flush(MJ_writer *w);
+
+/*
+*	compact binary form for caches on the same machine: numbers are stored
+*	in host byte order, so it is not portable between architectures.
+*	decoding returns MJ_PARSE_INVALID_VALUE for truncated or corrupt data.
+*/
+char* MJ_encode_binary(const MJ_value *v, size_t *length);
+int MJ_decode_binary(MJ_value *v, const char *data, size_t length);
+
 void MJ_free(MJ_value *v);
 
+/* deep copy, src may be part of dst */
+void MJ_copy(MJ_value *dst, const MJ_value *src);
+/* O(1), src is left as MJ_NULL and may be part of dst */
+void MJ_move(MJ_value *dst, MJ_value *src);
+void MJ_swap(MJ_value *lhs, MJ_value *rhs);
+int MJ_is_equal(const MJ_value *lhs, const MJ_value *rhs);
+
 MJ_type MJ_get_type(const MJ_value *v);
 
 #define MJ_set_null(v) MJ_free(v)
@@ -72,5 +186,115 @@ void MJ_set_string(MJ_value *v, const char *s, size_t len);
 
 size_t MJ_get_array_size(const MJ_value* v);
 MJ_value* MJ_get_array_element(const MJ_value* v, size_t index);
+void MJ_set_array(MJ_value *v, size_t capacity);
+size_t MJ_get_array_capacity(const MJ_value *v);
+void MJ_reserve_array(MJ_value *v, size_t capacity);
+void MJ_shrink_array(MJ_value *v);
+void MJ_clear_array(MJ_value *v);
+/* amortized O(1), the new element is MJ_NULL */
+MJ_value* MJ_pushback_array_element(MJ_value *v);
+void MJ_popback_array_element(MJ_value *v);
+MJ_value* MJ_insert_array_element(MJ_value *v, size_t index);
+void MJ_erase_array_element(MJ_value *v, size_t index, size_t count);
+
+#define MJ_KEY_NOT_EXIST ((size_t)-1)
+
+void MJ_set_object(MJ_value *v, size_t capacity);
+size_t MJ_get_object_size(const MJ_value *v);
+size_t MJ_get_object_capacity(const MJ_value *v);
+void MJ_reserve_object(MJ_value *v, size_t capacity);
+void MJ_shrink_object(MJ_value *v);
+void MJ_clear_object(MJ_value *v);
+const char* MJ_get_object_key(const MJ_value *v, size_t index);
+size_t MJ_get_object_key_length(const MJ_value *v, size_t index);
+MJ_value* MJ_get_object_value(const MJ_value *v, size_t index);
+size_t MJ_find_object_index(const MJ_value *v, const char *key, size_t klen);
+MJ_value* MJ_find_object_value(const MJ_value *v, const char *key, size_t klen);
+/* the existing value for key, or a new MJ_NULL member */
+MJ_value* MJ_set_object_value(MJ_value *v, const char *key, size_t klen);
+void MJ_remove_object_value(MJ_value *v, size_t index);
+
+/*
+*	schema-guided parsing: a JSON object is parsed straight into a struct,
+*	no MJ_value is built. declare the table with MJ_FIELD, e.g.
+*
+*	static const MJ_field fields[] = {
+*		MJ_FIELD(msg, id, INT, 1),
+*		MJ_FIELD_KEY(msg, price, "px", NUMBER, 0)
+*	};
+*	MJ_parse_struct(&m, fields, MJ_FIELD_COUNT(fields), json);
+*
+*	unknown keys are skipped, null leaves a member untouched, a value of
+*	the wrong type (or a string that does not fit) is MJ_PARSE_FIELD_MISMATCH.
+*/
+typedef enum
+{
+	MJ_FIELD_NUMBER,	/* double */
+	MJ_FIELD_INT,		/* int, the number must be integral */
+	MJ_FIELD_BOOLEAN,	/* int, 0 or 1 */
+	MJ_FIELD_STRING		/* char[N], always '\0' terminated */
+}MJ_field_type;
+
+typedef struct
+{
+	const char *key;
+	size_t klen;
+	MJ_field_type type;
+	size_t offset, size;
+	int required;
+}MJ_field;
+
+/* key must be a string literal */
+#define MJ_FIELD_KEY(st, m, key, t, req) { key, sizeof(key) - 1, MJ_FIELD_##t, offsetof(st, m), sizeof(((st*)0)->m), req }
+#define MJ_FIELD(st, m, t, req) MJ_FIELD_KEY(st, m, #m, t, req)
+#define MJ_FIELD_COUNT(fields) (sizeof(fields) / sizeof((fields)[0]))
+
+int MJ_parse_struct(void *s, const MJ_field *fields, size_t count, const char *json);
+
+/*
+*	in-place patching, the patch is consumed: its values are moved into
+*	the document rather than copied, and the patch is left as MJ_NULL.
+*/
+enum
+{
+	MJ_PATCH_OK = 0,
+	MJ_PATCH_INVALID_OPERATION,
+	MJ_PATCH_PATH_NOT_FOUND,
+	MJ_PATCH_TEST_FAILED
+};
+
+/* RFC 7396 JSON Merge Patch */
+void MJ_merge_patch(MJ_value *v, MJ_value *patch);
+/*
+*	RFC 6902 JSON Patch, patch is an array of operations applied in one pass.
+*	it stops at the first failing operation, the ones before it stay applied.
+*/
+int MJ_apply_patch(MJ_value *v, MJ_value *patch);
+
+/*
+*	shared documents: every function taking a const MJ_value* only reads
+*	the tree, so a frozen document can be read from any number of threads.
+*	MJ_shared_acquire() is lock-free and returns a reference to the current
+*	version. MJ_shared_swap() publishes a new one, the old tree is freed on a
+*	background thread once its last reference is released.
+*	(without MJ_ENABLE_THREADS they work, single-threaded, and free inline)
+*/
+typedef struct MJ_document MJ_document;
+typedef struct MJ_shared MJ_shared;
+
+/* moves v into a new document holding one reference, v is left as MJ_NULL */
+MJ_document* MJ_freeze(MJ_value *v);
+const MJ_value* MJ_document_root(const MJ_document *d);
+void MJ_document_retain(MJ_document *d);
+void MJ_document_release(MJ_document *d);
+
+/* takes over the reference to d */
+MJ_shared* MJ_shared_create(MJ_document *d);
+MJ_document* MJ_shared_acquire(MJ_shared *s);
+/* takes over the reference to d, releases the old version */
+void MJ_shared_swap(MJ_shared *s, MJ_document *d);
+void MJ_shared_destroy(MJ_shared *s);
+/* wait until every released document has been freed */
+void MJ_reclaim_wait(void);
 
 #endif
\ No newline at end of file
@@ -5,6 +5,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#ifdef MJ_ENABLE_THREADS
+#include <pthread.h>
+#endif
 #include "minijson.h"
 
 static int main_ret = 0;
@@ -357,6 +361,1003 @@ static void test_parse_array()
     MJ_free(&v);
 }
 
+typedef struct
+{
+    int id;
+    double price;
+    int active;
+    char name[8];
+}test_msg;
+
+static const MJ_field test_msg_fields[] = {
+    MJ_FIELD(test_msg, id, INT, 1),
+    MJ_FIELD_KEY(test_msg, price, "px", NUMBER, 0),
+    MJ_FIELD(test_msg, active, BOOLEAN, 0),
+    MJ_FIELD(test_msg, name, STRING, 1)
+};
+
+#define TEST_STRUCT_ERROR(error, json)\
+    do{\
+        test_msg m;\
+        EXPECT_EQ_INT(error, MJ_parse_struct(&m, test_msg_fields, MJ_FIELD_COUNT(test_msg_fields), json));\
+    }while(0)
+
+static void test_parse_struct()
+{
+    test_msg m;
+    memset(&m, 0, sizeof(m));
+    EXPECT_EQ_INT(MJ_PARSE_OK, MJ_parse_struct(&m, test_msg_fields, MJ_FIELD_COUNT(test_msg_fields),
+        " { \"name\" : \"a\\u00E9\" , \"extra\" : { \"k\" : [ 1 , \"x\" , null ] } , \"px\" : 1.5 , \"active\" : true , \"id\" : -42 } "));
+    EXPECT_EQ_INT(-42, m.id);
+    EXPECT_EQ_DOUBLE(1.5, m.price);
+    EXPECT_TRUE(m.active);
+    EXPECT_EQ_STRING("a\xC3\xA9", m.name, strlen(m.name));
+
+    memset(&m, 0, sizeof(m));
+    m.price = 2.0;
+    EXPECT_EQ_INT(MJ_PARSE_OK, MJ_parse_struct(&m, test_msg_fields, MJ_FIELD_COUNT(test_msg_fields),
+        "{\"id\":1,\"px\":null,\"name\":\"\"}"));
+    EXPECT_EQ_INT(1, m.id);
+    EXPECT_EQ_DOUBLE(2.0, m.price);
+    EXPECT_EQ_STRING("", m.name, strlen(m.name));
+
+    /* a key with an embedded NUL is not a prefix match */
+    memset(&m, 0, sizeof(m));
+    EXPECT_EQ_INT(MJ_PARSE_OK, MJ_parse_struct(&m, test_msg_fields, MJ_FIELD_COUNT(test_msg_fields),
+        "{\"id\\u0000zz\":7,\"id\":3,\"name\":\"a\"}"));
+    EXPECT_EQ_INT(3, m.id);
+
+    TEST_STRUCT_ERROR(MJ_PARSE_MISS_REQUIRED_FIELD, "{\"id\\u0000zz\":7,\"name\":\"a\"}");
+    TEST_STRUCT_ERROR(MJ_PARSE_MISS_REQUIRED_FIELD, "{}");
+    TEST_STRUCT_ERROR(MJ_PARSE_MISS_REQUIRED_FIELD, "{\"id\":1,\"name\":null}");
+    TEST_STRUCT_ERROR(MJ_PARSE_FIELD_MISMATCH, "{\"id\":1.5,\"name\":\"a\"}");
+    TEST_STRUCT_ERROR(MJ_PARSE_FIELD_MISMATCH, "{\"id\":\"1\",\"name\":\"a\"}");
+    TEST_STRUCT_ERROR(MJ_PARSE_FIELD_MISMATCH, "{\"id\":1,\"name\":\"12345678\"}");
+    TEST_STRUCT_ERROR(MJ_PARSE_FIELD_MISMATCH, "{\"id\":1,\"name\":[]}");
+    TEST_STRUCT_ERROR(MJ_PARSE_FIELD_MISMATCH, "[1]");
+    TEST_STRUCT_ERROR(MJ_PARSE_EXPECT_VALUE, "");
+    TEST_STRUCT_ERROR(MJ_PARSE_MISS_KEY, "{1:1}");
+    TEST_STRUCT_ERROR(MJ_PARSE_MISS_COLON, "{\"id\" 1}");
+    TEST_STRUCT_ERROR(MJ_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"id\":1 \"name\":\"a\"}");
+    TEST_STRUCT_ERROR(MJ_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "{\"x\":[1 2],\"id\":1,\"name\":\"a\"}");
+    TEST_STRUCT_ERROR(MJ_PARSE_INVALID_STRING_ESCAPE, "{\"x\":\"\\v\",\"id\":1,\"name\":\"a\"}");
+    TEST_STRUCT_ERROR(MJ_PARSE_ROOT_NOT_SINGULAR, "{\"id\":1,\"name\":\"a\"} x");
+}
+
+#define TEST_VALIDATE(error, json)\
+    do{\
+        EXPECT_EQ_INT(error, MJ_validate(json));\
+    }while(0)
+
+static void test_validate()
+{
+    size_t end;
+    TEST_VALIDATE(MJ_PARSE_OK, " null ");
+    TEST_VALIDATE(MJ_PARSE_OK, "-1.5e+10");
+    TEST_VALIDATE(MJ_PARSE_OK, "\"\\\" \\\\ \\/ \\b \\f \\n \\r \\t \\uD834\\uDD1E\"");
+    TEST_VALIDATE(MJ_PARSE_OK, "[ null , false , true , 123 , \"abc\" , [ ] , { } ]");
+    TEST_VALIDATE(MJ_PARSE_OK, "{ \"a\" : { \"b\" : [ 1 , { \"c\" : \"d\" } ] } , \"e\" : 1 }");
+
+    TEST_VALIDATE(MJ_PARSE_EXPECT_VALUE, " ");
+    TEST_VALIDATE(MJ_PARSE_INVALID_VALUE, "nul");
+    TEST_VALIDATE(MJ_PARSE_INVALID_VALUE, "+1");
+    TEST_VALIDATE(MJ_PARSE_INVALID_VALUE, "[1,]");
+    TEST_VALIDATE(MJ_PARSE_ROOT_NOT_SINGULAR, "null x");
+    TEST_VALIDATE(MJ_PARSE_ROOT_NOT_SINGULAR, "0123");
+    TEST_VALIDATE(MJ_PARSE_MISS_QUOTATION_MARK, "\"abc");
+    TEST_VALIDATE(MJ_PARSE_INVALID_STRING_ESCAPE, "\"\\v\"");
+    TEST_VALIDATE(MJ_PARSE_INVALID_STRING_CHAR, "\"\x01\"");
+    TEST_VALIDATE(MJ_PARSE_INVALID_UNICODE_HEX, "\"\\u00G0\"");
+    TEST_VALIDATE(MJ_PARSE_INVALID_UNICODE_SURROGATE, "\"\\uD800\\uE000\"");
+    TEST_VALIDATE(MJ_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "[1 2");
+    TEST_VALIDATE(MJ_PARSE_MISS_KEY, "{1:1}");
+    TEST_VALIDATE(MJ_PARSE_MISS_COLON, "{\"a\" 1}");
+    TEST_VALIDATE(MJ_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":1");
+
+    EXPECT_EQ_INT(MJ_PARSE_OK, MJ_skip(" [ 1 , [ 2 ] ] , 3", &end));
+    EXPECT_EQ_SIZE_T(14, end);
+    EXPECT_EQ_INT(MJ_PARSE_OK, MJ_skip("\"a\\\"b\"}", &end));
+    EXPECT_EQ_SIZE_T(6, end);
+    EXPECT_EQ_INT(MJ_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, MJ_skip("[1", &end));
+}
+
+#define TEST_EQUAL(json1, json2, equality) \
+    do {\
+        MJ_value v1, v2;\
+        MJ_init(&v1);\
+        MJ_init(&v2);\
+        EXPECT_EQ_INT(MJ_PARSE_OK, MJ_parse(&v1, json1));\
+        EXPECT_EQ_INT(MJ_PARSE_OK, MJ_parse(&v2, json2));\
+        EXPECT_EQ_INT(equality, MJ_is_equal(&v1, &v2));\
+        MJ_free(&v1);\
+        MJ_free(&v2);\
+    } while(0)
+
+static void test_equal()
+{
+    TEST_EQUAL("true", "true", 1);
+    TEST_EQUAL("true", "false", 0);
+    TEST_EQUAL("false", "false", 1);
+    TEST_EQUAL("null", "null", 1);
+    TEST_EQUAL("null", "0", 0);
+    TEST_EQUAL("123", "123", 1);
+    TEST_EQUAL("123", "456", 0);
+    TEST_EQUAL("\"abc\"", "\"abc\"", 1);
+    TEST_EQUAL("\"abc\"", "\"abcd\"", 0);
+    TEST_EQUAL("[]", "[]", 1);
+    TEST_EQUAL("[]", "null", 0);
+    TEST_EQUAL("[1,2,3]", "[1,2,3]", 1);
+    TEST_EQUAL("[1,2,3]", "[1,2,3,4]", 0);
+    TEST_EQUAL("[[]]", "[[]]", 1);
+    TEST_EQUAL("[[1,\"a\"],[]]", "[[1,\"b\"],[]]", 0);
+    TEST_EQUAL("{}", "{}", 1);
+    TEST_EQUAL("{\"a\":1,\"b\":[2]}", "{\"a\":1,\"b\":[2]}", 1);
+    TEST_EQUAL("{\"a\":1,\"b\":[2]}", "{\"b\":[2],\"a\":1}", 1);
+    TEST_EQUAL("{\"a\":1,\"b\":2}", "{\"a\":1,\"c\":2}", 0);
+    TEST_EQUAL("{\"a\":1}", "{\"a\":1,\"b\":2}", 0);
+    TEST_EQUAL("{\"a\":{\"x\":1,\"y\":2}}", "{\"a\":{\"y\":2,\"x\":1}}", 1);
+    /* duplicate keys are compared as a multiset, the same both ways round */
+    TEST_EQUAL("{\"a\":1,\"a\":1}", "{\"a\":1,\"a\":2}", 0);
+    TEST_EQUAL("{\"a\":1,\"a\":2}", "{\"a\":1,\"a\":1}", 0);
+    TEST_EQUAL("{\"a\":1,\"a\":2}", "{\"a\":2,\"a\":1}", 1);
+    TEST_EQUAL("{\"b\":0,\"a\":1,\"a\":2}", "{\"a\":2,\"b\":0,\"a\":1}", 1);
+}
+
+static void test_copy()
+{
+    MJ_value v1, v2;
+    MJ_init(&v1);
+    MJ_parse(&v1, "[ null , true , 1.5 , \"abc\" , [ [ ] , [ \"x\" , 2 ] ] ]");
+    MJ_init(&v2);
+    MJ_set_string(&v2, "old", 3);
+    MJ_copy(&v2, &v1);
+    EXPECT_TRUE(MJ_is_equal(&v2, &v1));
+    EXPECT_TRUE(MJ_get_array_element(&v1, 3)->u.s.s != MJ_get_array_element(&v2, 3)->u.s.s);
+    MJ_free(&v1);
+    EXPECT_EQ_SIZE_T(5, MJ_get_array_size(&v2));
+    MJ_free(&v2);
+}
+
+static void test_move()
+{
+    MJ_value v1, v2, v3;
+    MJ_init(&v1);
+    MJ_parse(&v1, "[ 1 , [ \"a\" ] ]");
+    MJ_init(&v2);
+    MJ_copy(&v2, &v1);
+    MJ_init(&v3);
+    MJ_move(&v3, &v2);
+    EXPECT_EQ_INT(MJ_NULL, MJ_get_type(&v2));
+    EXPECT_TRUE(MJ_is_equal(&v3, &v1));
+
+    /* replace a node with its own child */
+    MJ_parse(&v2, "[ 2 , [ \"a\" ] ]");
+    MJ_move(&v2, MJ_get_array_element(&v2, 1));
+    MJ_free(&v3);
+    MJ_parse(&v3, "[ \"a\" ]");
+    EXPECT_TRUE(MJ_is_equal(&v2, &v3));
+    MJ_copy(&v1, MJ_get_array_element(&v1, 1));
+    EXPECT_TRUE(MJ_is_equal(&v1, &v3));
+    MJ_free(&v1);
+    MJ_free(&v2);
+    MJ_free(&v3);
+}
+
+static void test_swap()
+{
+    MJ_value v1, v2;
+    MJ_init(&v1);
+    MJ_init(&v2);
+    MJ_set_string(&v1, "Hello",  5);
+    MJ_set_string(&v2, "World!", 6);
+    MJ_swap(&v1, &v2);
+    EXPECT_EQ_STRING("World!", MJ_get_string(&v1), MJ_get_string_length(&v1));
+    EXPECT_EQ_STRING("Hello",  MJ_get_string(&v2), MJ_get_string_length(&v2));
+    MJ_free(&v1);
+    MJ_free(&v2);
+}
+
+static void test_access_array()
+{
+    MJ_value a, e;
+    size_t i, j;
+
+    MJ_init(&a);
+
+    for (j = 0; j <= 5; j += 5) {
+        MJ_set_array(&a, j);
+        EXPECT_EQ_SIZE_T(0, MJ_get_array_size(&a));
+        EXPECT_EQ_SIZE_T(j, MJ_get_array_capacity(&a));
+        for (i = 0; i < 10; i++) {
+            MJ_init(&e);
+            MJ_set_number(&e, i);
+            MJ_move(MJ_pushback_array_element(&a), &e);
+            MJ_free(&e);
+        }
+
+        EXPECT_EQ_SIZE_T(10, MJ_get_array_size(&a));
+        for (i = 0; i < 10; i++)
+            EXPECT_EQ_DOUBLE((double)i, MJ_get_number(MJ_get_array_element(&a, i)));
+    }
+
+    MJ_popback_array_element(&a);
+    EXPECT_EQ_SIZE_T(9, MJ_get_array_size(&a));
+    for (i = 0; i < 9; i++)
+        EXPECT_EQ_DOUBLE((double)i, MJ_get_number(MJ_get_array_element(&a, i)));
+
+    MJ_erase_array_element(&a, 4, 0);
+    EXPECT_EQ_SIZE_T(9, MJ_get_array_size(&a));
+    for (i = 0; i < 9; i++)
+        EXPECT_EQ_DOUBLE((double)i, MJ_get_number(MJ_get_array_element(&a, i)));
+
+    MJ_erase_array_element(&a, 8, 1);
+    EXPECT_EQ_SIZE_T(8, MJ_get_array_size(&a));
+    for (i = 0; i < 8; i++)
+        EXPECT_EQ_DOUBLE((double)i, MJ_get_number(MJ_get_array_element(&a, i)));
+
+    MJ_erase_array_element(&a, 0, 2);
+    EXPECT_EQ_SIZE_T(6, MJ_get_array_size(&a));
+    for (i = 0; i < 6; i++)
+        EXPECT_EQ_DOUBLE((double)i + 2, MJ_get_number(MJ_get_array_element(&a, i)));
+
+    for (i = 0; i < 2; i++) {
+        MJ_init(&e);
+        MJ_set_number(&e, i);
+        MJ_move(MJ_insert_array_element(&a, i), &e);
+        MJ_free(&e);
+    }
+
+    EXPECT_EQ_SIZE_T(8, MJ_get_array_size(&a));
+    for (i = 0; i < 8; i++)
+        EXPECT_EQ_DOUBLE((double)i, MJ_get_number(MJ_get_array_element(&a, i)));
+
+    EXPECT_TRUE(MJ_get_array_capacity(&a) > 8);
+    MJ_shrink_array(&a);
+    EXPECT_EQ_SIZE_T(8, MJ_get_array_capacity(&a));
+    EXPECT_EQ_SIZE_T(8, MJ_get_array_size(&a));
+    for (i = 0; i < 8; i++)
+        EXPECT_EQ_DOUBLE((double)i, MJ_get_number(MJ_get_array_element(&a, i)));
+
+    MJ_set_string(&e, "Hello", 5);
+    MJ_move(MJ_pushback_array_element(&a), &e);     /* Test if element is freed */
+    MJ_free(&e);
+
+    i = MJ_get_array_capacity(&a);
+    MJ_clear_array(&a);
+    EXPECT_EQ_SIZE_T(0, MJ_get_array_size(&a));
+    EXPECT_EQ_SIZE_T(i, MJ_get_array_capacity(&a));   /* capacity remains unchanged */
+    MJ_shrink_array(&a);
+    EXPECT_EQ_SIZE_T(0, MJ_get_array_capacity(&a));
+
+    MJ_free(&a);
+}
+
+#define TEST_PARSE_FLAGS(json, flags)\
+    do{\
+        MJ_value v1, v2;\
+        MJ_init(&v1);\
+        MJ_init(&v2);\
+        EXPECT_EQ_INT(MJ_PARSE_OK, MJ_parse(&v1, json));\
+        EXPECT_EQ_INT(MJ_PARSE_OK, MJ_parse_flags(&v2, json, flags));\
+        EXPECT_TRUE(MJ_is_equal(&v1, &v2));\
+        MJ_free(&v1);\
+        MJ_free(&v2);\
+    }while(0)
+
+static void test_parse_flags()
+{
+    MJ_value v;
+    char big[403];
+
+    TEST_PARSE_FLAGS("[ \"\" , \"Hello\" , \"a\\\"b\\\\c\\u00E9\\uD834\\uDD1Ed\" , -1.5e-3 , 1.7976931348623157e+308 ]", MJ_PARSE_TRUSTED);
+    TEST_PARSE_FLAGS("[ 0 , -0 , 7 , -123 , 999999999999999 , 12345678901234567890 , -9007199254740993 ]", MJ_PARSE_INTEGER_ONLY);
+    TEST_PARSE_FLAGS("[ 42 , \"x\\ny\" , [ -1 ] ]", MJ_PARSE_TRUSTED | MJ_PARSE_INTEGER_ONLY);
+
+    MJ_init(&v);
+    EXPECT_EQ_INT(MJ_PARSE_INVALID_VALUE, MJ_parse_flags(&v, "1.5", MJ_PARSE_INTEGER_ONLY));
+    EXPECT_EQ_INT(MJ_PARSE_INVALID_VALUE, MJ_parse_flags(&v, "1e3", MJ_PARSE_INTEGER_ONLY));
+    /* too big for a double, like MJ_parse() */
+    big[0] = '[';
+    memset(big + 1, '9', 400);
+    big[401] = ']';
+    big[402] = '\0';
+    EXPECT_EQ_INT(MJ_PARSE_INVALID_VALUE, MJ_parse(&v, big));
+    EXPECT_EQ_INT(MJ_PARSE_INVALID_VALUE, MJ_parse_flags(&v, big, MJ_PARSE_INTEGER_ONLY));
+    big[0] = '-';
+    big[401] = '\0';
+    EXPECT_EQ_INT(MJ_PARSE_INVALID_VALUE, MJ_parse_flags(&v, big, MJ_PARSE_INTEGER_ONLY));
+    EXPECT_EQ_INT(MJ_PARSE_INVALID_VALUE, MJ_parse_flags(&v, "-", MJ_PARSE_INTEGER_ONLY));
+    EXPECT_EQ_INT(MJ_PARSE_MISS_QUOTATION_MARK, MJ_parse_flags(&v, "\"abc", MJ_PARSE_TRUSTED));
+    EXPECT_EQ_INT(MJ_PARSE_OK, MJ_parse_flags(&v, "\"\x01\"", MJ_PARSE_TRUSTED));
+    EXPECT_EQ_STRING("\x01", MJ_get_string(&v), MJ_get_string_length(&v));
+    MJ_free(&v);
+}
+
+static void test_parse_object()
+{
+    MJ_value v;
+    size_t i;
+
+    MJ_init(&v);
+    EXPECT_EQ_INT(MJ_PARSE_OK, MJ_parse(&v, " { } "));
+    EXPECT_EQ_INT(MJ_OBJECT, MJ_get_type(&v));
+    EXPECT_EQ_SIZE_T(0, MJ_get_object_size(&v));
+    MJ_free(&v);
+
+    MJ_init(&v);
+    EXPECT_EQ_INT(MJ_PARSE_OK, MJ_parse(&v,
+        " { "
+        "\"n\" : null , "
+        "\"f\" : false , "
+        "\"t\" : true , "
+        "\"i\" : 123 , "
+        "\"s\" : \"abc\", "
+        "\"a\" : [ 1, 2, 3 ],"
+        "\"o\" : { \"1\" : 1, \"2\" : 2, \"3\" : 3 }"
+        " } "
+    ));
+    EXPECT_EQ_INT(MJ_OBJECT, MJ_get_type(&v));
+    EXPECT_EQ_SIZE_T(7, MJ_get_object_size(&v));
+    EXPECT_EQ_STRING("n", MJ_get_object_key(&v, 0), MJ_get_object_key_length(&v, 0));
+    EXPECT_EQ_INT(MJ_NULL,   MJ_get_type(MJ_get_object_value(&v, 0)));
+    EXPECT_EQ_STRING("f", MJ_get_object_key(&v, 1), MJ_get_object_key_length(&v, 1));
+    EXPECT_EQ_INT(MJ_FALSE,  MJ_get_type(MJ_get_object_value(&v, 1)));
+    EXPECT_EQ_STRING("t", MJ_get_object_key(&v, 2), MJ_get_object_key_length(&v, 2));
+    EXPECT_EQ_INT(MJ_TRUE,   MJ_get_type(MJ_get_object_value(&v, 2)));
+    EXPECT_EQ_STRING("i", MJ_get_object_key(&v, 3), MJ_get_object_key_length(&v, 3));
+    EXPECT_EQ_INT(MJ_NUMBER, MJ_get_type(MJ_get_object_value(&v, 3)));
+    EXPECT_EQ_DOUBLE(123.0, MJ_get_number(MJ_get_object_value(&v, 3)));
+    EXPECT_EQ_STRING("s", MJ_get_object_key(&v, 4), MJ_get_object_key_length(&v, 4));
+    EXPECT_EQ_INT(MJ_STRING, MJ_get_type(MJ_get_object_value(&v, 4)));
+    EXPECT_EQ_STRING("abc", MJ_get_string(MJ_get_object_value(&v, 4)), MJ_get_string_length(MJ_get_object_value(&v, 4)));
+    EXPECT_EQ_STRING("a", MJ_get_object_key(&v, 5), MJ_get_object_key_length(&v, 5));
+    EXPECT_EQ_INT(MJ_ARRAY, MJ_get_type(MJ_get_object_value(&v, 5)));
+    EXPECT_EQ_SIZE_T(3, MJ_get_array_size(MJ_get_object_value(&v, 5)));
+    for (i = 0; i < 3; i++) {
+        MJ_value* e = MJ_get_array_element(MJ_get_object_value(&v, 5), i);
+        EXPECT_EQ_INT(MJ_NUMBER, MJ_get_type(e));
+        EXPECT_EQ_DOUBLE(i + 1.0, MJ_get_number(e));
+    }
+    EXPECT_EQ_STRING("o", MJ_get_object_key(&v, 6), MJ_get_object_key_length(&v, 6));
+    {
+        MJ_value* o = MJ_get_object_value(&v, 6);
+        EXPECT_EQ_INT(MJ_OBJECT, MJ_get_type(o));
+        for (i = 0; i < 3; i++) {
+            MJ_value* ov = MJ_get_object_value(o, i);
+            EXPECT_TRUE((char)('1' + i) == MJ_get_object_key(o, i)[0]);
+            EXPECT_EQ_SIZE_T(1, MJ_get_object_key_length(o, i));
+            EXPECT_EQ_INT(MJ_NUMBER, MJ_get_type(ov));
+            EXPECT_EQ_DOUBLE(i + 1.0, MJ_get_number(ov));
+        }
+    }
+    MJ_free(&v);
+}
+
+static void test_parse_object_error()
+{
+    TEST_ERROR(MJ_PARSE_MISS_KEY, "{:1,");
+    TEST_ERROR(MJ_PARSE_MISS_KEY, "{1:1,");
+    TEST_ERROR(MJ_PARSE_MISS_KEY, "{true:1,");
+    TEST_ERROR(MJ_PARSE_MISS_KEY, "{\"a\":1,}");
+    TEST_ERROR(MJ_PARSE_MISS_COLON, "{\"a\"}");
+    TEST_ERROR(MJ_PARSE_MISS_COLON, "{\"a\",\"b\"}");
+    TEST_ERROR(MJ_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":1");
+    TEST_ERROR(MJ_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":1]");
+    TEST_ERROR(MJ_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":1 \"b\"");
+    TEST_ERROR(MJ_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":{}");
+    TEST_ERROR(MJ_PARSE_INVALID_VALUE, "{\"a\":[\"x\",nul]}");
+}
+
+static void test_access_object()
+{
+    MJ_value o, v, *pv;
+    size_t i, j, index;
+
+    MJ_init(&o);
+
+    for (j = 0; j <= 5; j += 5) {
+        MJ_set_object(&o, j);
+        EXPECT_EQ_SIZE_T(0, MJ_get_object_size(&o));
+        EXPECT_EQ_SIZE_T(j, MJ_get_object_capacity(&o));
+        for (i = 0; i < 10; i++) {
+            char key[2] = "a";
+            key[0] += i;
+            MJ_init(&v);
+            MJ_set_number(&v, i);
+            MJ_move(MJ_set_object_value(&o, key, 1), &v);
+            MJ_free(&v);
+        }
+        EXPECT_EQ_SIZE_T(10, MJ_get_object_size(&o));
+        for (i = 0; i < 10; i++) {
+            char key[] = "a";
+            key[0] += i;
+            index = MJ_find_object_index(&o, key, 1);
+            EXPECT_TRUE(index != MJ_KEY_NOT_EXIST);
+            pv = MJ_get_object_value(&o, index);
+            EXPECT_EQ_DOUBLE((double)i, MJ_get_number(pv));
+        }
+    }
+
+    index = MJ_find_object_index(&o, "j", 1);
+    EXPECT_TRUE(index != MJ_KEY_NOT_EXIST);
+    MJ_remove_object_value(&o, index);
+    index = MJ_find_object_index(&o, "j", 1);
+    EXPECT_TRUE(index == MJ_KEY_NOT_EXIST);
+    EXPECT_EQ_SIZE_T(9, MJ_get_object_size(&o));
+
+    index = MJ_find_object_index(&o, "a", 1);
+    EXPECT_TRUE(index != MJ_KEY_NOT_EXIST);
+    MJ_remove_object_value(&o, index);
+    index = MJ_find_object_index(&o, "a", 1);
+    EXPECT_TRUE(index == MJ_KEY_NOT_EXIST);
+    EXPECT_EQ_SIZE_T(8, MJ_get_object_size(&o));
+
+    EXPECT_TRUE(MJ_get_object_capacity(&o) > 8);
+    MJ_shrink_object(&o);
+    EXPECT_EQ_SIZE_T(8, MJ_get_object_capacity(&o));
+    EXPECT_EQ_SIZE_T(8, MJ_get_object_size(&o));
+    for (i = 0; i < 8; i++) {
+        char key[] = "a";
+        key[0] += i + 1;
+        EXPECT_EQ_DOUBLE((double)i + 1, MJ_get_number(MJ_get_object_value(&o, MJ_find_object_index(&o, key, 1))));
+    }
+
+    MJ_set_string(&v, "Hello", 5);
+    MJ_move(MJ_set_object_value(&o, "World", 5), &v); /* Test if element is freed */
+    MJ_free(&v);
+
+    pv = MJ_find_object_value(&o, "World", 5);
+    EXPECT_TRUE(pv != NULL);
+    EXPECT_EQ_STRING("Hello", MJ_get_string(pv), MJ_get_string_length(pv));
+
+    i = MJ_get_object_capacity(&o);
+    MJ_clear_object(&o);
+    EXPECT_EQ_SIZE_T(0, MJ_get_object_size(&o));
+    EXPECT_EQ_SIZE_T(i, MJ_get_object_capacity(&o)); /* capacity remains unchanged */
+    MJ_shrink_object(&o);
+    EXPECT_EQ_SIZE_T(0, MJ_get_object_capacity(&o));
+
+    MJ_free(&o);
+}
+
+#define TEST_MERGE_PATCH(expect, json, patch)\
+    do{\
+        MJ_value v, p, e;\
+        MJ_init(&v);\
+        MJ_init(&p);\
+        MJ_init(&e);\
+        EXPECT_EQ_INT(MJ_PARSE_OK, MJ_parse(&v, json));\
+        EXPECT_EQ_INT(MJ_PARSE_OK, MJ_parse(&p, patch));\
+        EXPECT_EQ_INT(MJ_PARSE_OK, MJ_parse(&e, expect));\
+        MJ_merge_patch(&v, &p);\
+        EXPECT_TRUE(MJ_is_equal(&e, &v));\
+        EXPECT_EQ_INT(MJ_NULL, MJ_get_type(&p));\
+        MJ_free(&v);\
+        MJ_free(&e);\
+    }while(0)
+
+static void test_merge_patch()
+{
+    /* RFC 7396 Appendix A */
+    TEST_MERGE_PATCH("{\"a\":\"c\"}", "{\"a\":\"b\"}", "{\"a\":\"c\"}");
+    TEST_MERGE_PATCH("{\"a\":\"b\",\"b\":\"c\"}", "{\"a\":\"b\"}", "{\"b\":\"c\"}");
+    TEST_MERGE_PATCH("{}", "{\"a\":\"b\"}", "{\"a\":null}");
+    TEST_MERGE_PATCH("{\"b\":\"c\"}", "{\"a\":\"b\",\"b\":\"c\"}", "{\"a\":null}");
+    TEST_MERGE_PATCH("{\"a\":\"c\"}", "{\"a\":[\"b\"]}", "{\"a\":\"c\"}");
+    TEST_MERGE_PATCH("{\"a\":[\"b\"]}", "{\"a\":\"c\"}", "{\"a\":[\"b\"]}");
+    TEST_MERGE_PATCH("{\"a\":{\"b\":\"d\"}}", "{\"a\":{\"b\":\"c\"}}", "{\"a\":{\"b\":\"d\",\"c\":null}}");
+    TEST_MERGE_PATCH("{\"a\":[1]}", "{\"a\":[{\"b\":\"c\"}]}", "{\"a\":[1]}");
+    TEST_MERGE_PATCH("[\"c\",\"d\"]", "[\"a\",\"b\"]", "[\"c\",\"d\"]");
+    TEST_MERGE_PATCH("[\"c\"]", "{\"a\":\"b\"}", "[\"c\"]");
+    TEST_MERGE_PATCH("null", "{\"a\":\"foo\"}", "null");
+    TEST_MERGE_PATCH("\"bar\"", "{\"a\":\"foo\"}", "\"bar\"");
+    TEST_MERGE_PATCH("{\"e\":null,\"a\":1}", "{\"e\":null}", "{\"a\":1}");
+    TEST_MERGE_PATCH("{\"a\":\"foo\"}", "[1,2]", "{\"a\":\"foo\",\"b\":null}");
+    TEST_MERGE_PATCH("{\"a\":{\"bb\":{}}}", "{}", "{\"a\":{\"bb\":{\"ccc\":null}}}");
+}
+
+#define TEST_APPLY_PATCH(error, expect, json, patch)\
+    do{\
+        MJ_value v, p, e;\
+        MJ_init(&v);\
+        MJ_init(&p);\
+        MJ_init(&e);\
+        EXPECT_EQ_INT(MJ_PARSE_OK, MJ_parse(&v, json));\
+        EXPECT_EQ_INT(MJ_PARSE_OK, MJ_parse(&p, patch));\
+        EXPECT_EQ_INT(MJ_PARSE_OK, MJ_parse(&e, expect));\
+        EXPECT_EQ_INT(error, MJ_apply_patch(&v, &p));\
+        EXPECT_TRUE(MJ_is_equal(&e, &v));\
+        EXPECT_EQ_INT(MJ_NULL, MJ_get_type(&p));\
+        MJ_free(&v);\
+        MJ_free(&e);\
+    }while(0)
+
+static void test_apply_patch()
+{
+    /* RFC 6902 Appendix A */
+    TEST_APPLY_PATCH(MJ_PATCH_OK, "{\"baz\":\"qux\",\"foo\":\"bar\"}",
+        "{\"foo\":\"bar\"}", "[{\"op\":\"add\",\"path\":\"/baz\",\"value\":\"qux\"}]");
+    TEST_APPLY_PATCH(MJ_PATCH_OK, "{\"foo\":[\"bar\",\"qux\",\"baz\"]}",
+        "{\"foo\":[\"bar\",\"baz\"]}", "[{\"op\":\"add\",\"path\":\"/foo/1\",\"value\":\"qux\"}]");
+    TEST_APPLY_PATCH(MJ_PATCH_OK, "{\"foo\":\"bar\"}",
+        "{\"baz\":\"qux\",\"foo\":\"bar\"}", "[{\"op\":\"remove\",\"path\":\"/baz\"}]");
+    TEST_APPLY_PATCH(MJ_PATCH_OK, "{\"foo\":[\"bar\",\"baz\"]}",
+        "{\"foo\":[\"bar\",\"qux\",\"baz\"]}", "[{\"op\":\"remove\",\"path\":\"/foo/1\"}]");
+    TEST_APPLY_PATCH(MJ_PATCH_OK, "{\"baz\":\"boo\",\"foo\":\"bar\"}",
+        "{\"baz\":\"qux\",\"foo\":\"bar\"}", "[{\"op\":\"replace\",\"path\":\"/baz\",\"value\":\"boo\"}]");
+    TEST_APPLY_PATCH(MJ_PATCH_OK, "{\"foo\":{\"bar\":\"baz\"},\"qux\":{\"corge\":\"grault\",\"thud\":\"fred\"}}",
+        "{\"foo\":{\"bar\":\"baz\",\"waldo\":\"fred\"},\"qux\":{\"corge\":\"grault\"}}",
+        "[{\"op\":\"move\",\"from\":\"/foo/waldo\",\"path\":\"/qux/thud\"}]");
+    TEST_APPLY_PATCH(MJ_PATCH_OK, "{\"foo\":[\"all\",\"cows\",\"eat\",\"grass\"]}",
+        "{\"foo\":[\"all\",\"grass\",\"cows\",\"eat\"]}", "[{\"op\":\"move\",\"from\":\"/foo/1\",\"path\":\"/foo/3\"}]");
+    TEST_APPLY_PATCH(MJ_PATCH_OK, "{\"baz\":\"qux\",\"foo\":[\"a\",2,\"c\"]}",
+        "{\"baz\":\"qux\",\"foo\":[\"a\",2,\"c\"]}",
+        "[{\"op\":\"test\",\"path\":\"/baz\",\"value\":\"qux\"},{\"op\":\"test\",\"path\":\"/foo/1\",\"value\":2}]");
+    TEST_APPLY_PATCH(MJ_PATCH_TEST_FAILED, "{\"baz\":\"qux\"}",
+        "{\"baz\":\"qux\"}", "[{\"op\":\"test\",\"path\":\"/baz\",\"value\":\"bar\"}]");
+    TEST_APPLY_PATCH(MJ_PATCH_OK, "{\"foo\":\"bar\",\"child\":{\"grandchild\":{}}}",
+        "{\"foo\":\"bar\"}", "[{\"op\":\"add\",\"path\":\"/child\",\"value\":{\"grandchild\":{}}}]");
+    TEST_APPLY_PATCH(MJ_PATCH_PATH_NOT_FOUND, "{\"foo\":\"bar\"}",
+        "{\"foo\":\"bar\"}", "[{\"op\":\"add\",\"path\":\"/baz/bat\",\"value\":\"qux\"}]");
+    TEST_APPLY_PATCH(MJ_PATCH_OK, "{\"/\":9,\"~1\":10,\"x\":10}",
+        "{\"/\":9,\"~1\":10}", "[{\"op\":\"test\",\"path\":\"/~01\",\"value\":10},{\"op\":\"copy\",\"from\":\"/~01\",\"path\":\"/x\"}]");
+    TEST_APPLY_PATCH(MJ_PATCH_OK, "{\"foo\":[\"bar\",[\"abc\",\"def\"]]}",
+        "{\"foo\":[\"bar\"]}", "[{\"op\":\"add\",\"path\":\"/foo/-\",\"value\":[\"abc\",\"def\"]}]");
+
+    /* several operations in one pass, the root and errors */
+    TEST_APPLY_PATCH(MJ_PATCH_OK, "{\"a\":[1,3]}",
+        "[1]", "[{\"op\":\"replace\",\"path\":\"\",\"value\":{\"a\":[1,2]}},{\"op\":\"add\",\"path\":\"/a/2\",\"value\":3},{\"op\":\"remove\",\"path\":\"/a/1\"}]");
+    TEST_APPLY_PATCH(MJ_PATCH_PATH_NOT_FOUND, "{\"a\":2}",
+        "{\"a\":1}", "[{\"op\":\"replace\",\"path\":\"/a\",\"value\":2},{\"op\":\"remove\",\"path\":\"/a/b\"}]");
+    TEST_APPLY_PATCH(MJ_PATCH_PATH_NOT_FOUND, "{\"a\":[0,1]}",
+        "{\"a\":[0,1]}", "[{\"op\":\"remove\",\"path\":\"/a/01\"}]");
+    /* a move whose target is missing leaves the value where it was */
+    TEST_APPLY_PATCH(MJ_PATCH_PATH_NOT_FOUND, "{\"a\":1,\"b\":2}",
+        "{\"a\":1,\"b\":2}", "[{\"op\":\"move\",\"from\":\"/a\",\"path\":\"/nope/x\"}]");
+    TEST_APPLY_PATCH(MJ_PATCH_PATH_NOT_FOUND, "[0,[1],2]",
+        "[0,[1],2]", "[{\"op\":\"move\",\"from\":\"/0\",\"path\":\"/1/5\"}]");
+    {
+        MJ_value v, p;
+        char* json;
+        MJ_init(&v);
+        MJ_init(&p);
+        MJ_parse(&v, "{\"a\":1,\"b\":2,\"c\":3}");
+        MJ_parse(&p, "[{\"op\":\"move\",\"from\":\"/b\",\"path\":\"/c/x\"}]");
+        EXPECT_EQ_INT(MJ_PATCH_PATH_NOT_FOUND, MJ_apply_patch(&v, &p));
+        json = MJ_stringify(&v, NULL);
+        EXPECT_EQ_STRING("{\"a\":1,\"b\":2,\"c\":3}", json, strlen(json));
+        free(json);
+        MJ_free(&v);
+    }
+    TEST_APPLY_PATCH(MJ_PATCH_INVALID_OPERATION, "{\"a\":{\"b\":1}}",
+        "{\"a\":{\"b\":1}}", "[{\"op\":\"move\",\"from\":\"/a\",\"path\":\"/a/b\"}]");
+    TEST_APPLY_PATCH(MJ_PATCH_INVALID_OPERATION, "{}", "{}", "[{\"op\":\"frob\",\"path\":\"\"}]");
+    TEST_APPLY_PATCH(MJ_PATCH_INVALID_OPERATION, "{}", "{}", "[{\"op\":\"add\",\"path\":\"/a\"}]");
+    TEST_APPLY_PATCH(MJ_PATCH_INVALID_OPERATION, "{}", "{}", "{\"op\":\"add\",\"path\":\"/a\",\"value\":1}");
+}
+
+#define TEST_ROUNDTRIP(json)\
+    do {\
+        MJ_value v;\
+        char* json2;\
+        size_t length;\
+        MJ_init(&v);\
+        EXPECT_EQ_INT(MJ_PARSE_OK, MJ_parse(&v, json));\
+        json2 = MJ_stringify(&v, &length);\
+        EXPECT_EQ_STRING(json, json2, length);\
+        MJ_free(&v);\
+        free(json2);\
+    } while(0)
+
+static void test_stringify_number()
+{
+    TEST_ROUNDTRIP("0");
+    TEST_ROUNDTRIP("-0");
+    TEST_ROUNDTRIP("1");
+    TEST_ROUNDTRIP("-1");
+    TEST_ROUNDTRIP("1.5");
+    TEST_ROUNDTRIP("-1.5");
+    TEST_ROUNDTRIP("3.25");
+    TEST_ROUNDTRIP("1e+20");
+    TEST_ROUNDTRIP("1.234e+20");
+    TEST_ROUNDTRIP("1.234e-20");
+
+    TEST_ROUNDTRIP("1.0000000000000002"); /* the smallest number > 1 */
+    TEST_ROUNDTRIP("4.9406564584124654e-324"); /* minimum denormal */
+    TEST_ROUNDTRIP("-4.9406564584124654e-324");
+    TEST_ROUNDTRIP("2.2250738585072009e-308");  /* Max subnormal double */
+    TEST_ROUNDTRIP("-2.2250738585072009e-308");
+    TEST_ROUNDTRIP("2.2250738585072014e-308");  /* Min normal positive double */
+    TEST_ROUNDTRIP("-2.2250738585072014e-308");
+    TEST_ROUNDTRIP("1.7976931348623157e+308");  /* Max double */
+    TEST_ROUNDTRIP("-1.7976931348623157e+308");
+
+    /* no NaN or infinity in JSON */
+    {
+        MJ_value v;
+        char* json;
+        size_t length;
+        MJ_init(&v);
+        EXPECT_EQ_INT(MJ_PARSE_OK, MJ_parse(&v, "[0,1,2]"));
+        MJ_set_number(MJ_get_array_element(&v, 0), HUGE_VAL);
+        MJ_set_number(MJ_get_array_element(&v, 1), -HUGE_VAL);
+        MJ_set_number(MJ_get_array_element(&v, 2), HUGE_VAL - HUGE_VAL);
+        json = MJ_stringify(&v, &length);
+        EXPECT_EQ_STRING("[null,null,null]", json, length);
+        EXPECT_EQ_INT(MJ_PARSE_OK, MJ_validate(json));
+        free(json);
+        MJ_free(&v);
+    }
+}
+
+static void test_stringify_string()
+{
+    TEST_ROUNDTRIP("\"\"");
+    TEST_ROUNDTRIP("\"Hello\"");
+    TEST_ROUNDTRIP("\"Hello\\nWorld\"");
+    TEST_ROUNDTRIP("\"\\\" \\\\ / \\b \\f \\n \\r \\t\"");
+    TEST_ROUNDTRIP("\"Hello\\u0000World\"");
+}
+
+static void test_stringify_array()
+{
+    TEST_ROUNDTRIP("[]");
+    TEST_ROUNDTRIP("[null,false,true,123,\"abc\",[1,2,3]]");
+}
+
+static void test_stringify_object()
+{
+    TEST_ROUNDTRIP("{}");
+    TEST_ROUNDTRIP("{\"n\":null,\"f\":false,\"t\":true,\"i\":123,\"s\":\"abc\",\"a\":[1,2,3],\"o\":{\"1\":1,\"2\":2,\"3\":3}}");
+}
+
+static void test_stringify()
+{
+    TEST_ROUNDTRIP("null");
+    TEST_ROUNDTRIP("false");
+    TEST_ROUNDTRIP("true");
+    test_stringify_number();
+    test_stringify_string();
+    test_stringify_array();
+    test_stringify_object();
+}
+
+#define TEST_STRINGIFY_PARALLEL(v, threads)\
+    do {\
+        char *json1, *json2;\
+        size_t length1, length2;\
+        json1 = MJ_stringify(v, &length1);\
+        json2 = MJ_stringify_parallel(v, &length2, threads);\
+        EXPECT_EQ_SIZE_T(length1, length2);\
+        EXPECT_TRUE(length1 == length2 && memcmp(json1, json2, length1 + 1) == 0);\
+        free(json1);\
+        free(json2);\
+    } while(0)
+
+static void test_stringify_parallel()
+{
+    MJ_value a, o, d, *e;
+    size_t i;
+    char key[16];
+
+    MJ_init(&a);
+    MJ_init(&o);
+    MJ_set_array(&a, 0);
+    MJ_set_object(&o, 0);
+    for (i = 0; i < 10000; i++) {
+        MJ_value* e = MJ_pushback_array_element(&a);
+        sprintf(key, "k%u", (unsigned)i);
+        if (i % 3 == 0)
+            MJ_set_number(e, i * 0.5);
+        else if (i % 3 == 1)
+            MJ_set_string(e, key, strlen(key));
+        else
+            MJ_parse(e, "[true,{\"x\":null}]");
+        MJ_copy(MJ_set_object_value(&o, key, strlen(key)), e);
+    }
+    TEST_STRINGIFY_PARALLEL(&a, 1);
+    TEST_STRINGIFY_PARALLEL(&a, 3);
+    TEST_STRINGIFY_PARALLEL(&a, 8);
+    TEST_STRINGIFY_PARALLEL(&a, 64);
+    TEST_STRINGIFY_PARALLEL(&o, 4);
+    TEST_STRINGIFY_PARALLEL(MJ_get_array_element(&a, 2), 4);
+
+    /* large containers below a small root are split too */
+    MJ_init(&d);
+    MJ_set_object(&d, 0);
+    MJ_parse(MJ_set_object_value(&d, "meta", 4), "{\"v\":1}");
+    MJ_copy(MJ_set_object_value(&d, "rows", 4), &a);
+    e = MJ_set_object_value(&d, "more", 4);
+    MJ_set_array(e, 0);
+    MJ_copy(MJ_pushback_array_element(e), &o);
+    MJ_set_string(MJ_pushback_array_element(e), "x", 1);
+    TEST_STRINGIFY_PARALLEL(&d, 2);
+    TEST_STRINGIFY_PARALLEL(&d, 3);
+    TEST_STRINGIFY_PARALLEL(&d, 8);
+    MJ_free(&d);
+    MJ_free(&a);
+    MJ_free(&o);
+}
+
+typedef struct
+{
+    char* json;
+    size_t size, capacity;
+    size_t calls, fail_after;
+}test_sink;
+
+static int test_sink_write(void* user, const char* data, size_t len)
+{
+    test_sink* k = (test_sink*)user;
+    if (++k->calls > k->fail_after)
+        return -1;
+    if (k->size + len + 1 > k->capacity) {
+        while (k->size + len + 1 > k->capacity)
+            k->capacity = k->capacity ? k->capacity * 2 : 256;
+        k->json = (char*)realloc(k->json, k->capacity);
+    }
+    memcpy(k->json + k->size, data, len);
+    k->size += len;
+    k->json[k->size] = '\0';
+    return 0;
+}
+
+static void test_sink_init(test_sink* k)
+{
+    k->json = NULL;
+    k->size = k->capacity = k->calls = 0;
+    k->fail_after = (size_t)-1;
+}
+
+static void test_writer()
+{
+    MJ_writer w;
+    test_sink k;
+    MJ_value v;
+    char* json;
+    size_t length, i;
+    char big[4000];
+
+    test_sink_init(&k);
+    MJ_writer_init(&w, test_sink_write, &k);
+    MJ_write_begin_object(&w);
+    MJ_write_key(&w, "a", 1);
+    MJ_write_begin_array(&w);
+    MJ_write_null(&w);
+    MJ_write_boolean(&w, 0);
+    MJ_write_boolean(&w, 1);
+    MJ_write_number(&w, 1.5);
+    MJ_write_string(&w, "x\ny", 3);
+    MJ_write_begin_object(&w);
+    MJ_write_end_object(&w);
+    MJ_write_end_array(&w);
+    MJ_write_key(&w, "b", 1);
+    MJ_write_begin_array(&w);
+    MJ_write_end_array(&w);
+    MJ_write_end_object(&w);
+    EXPECT_EQ_INT(MJ_WRITE_OK, MJ_writer_flush(&w));
+    EXPECT_EQ_STRING("{\"a\":[null,false,true,1.5,\"x\\ny\",{}],\"b\":[]}", k.json, k.size);
+    free(k.json);
+
+    /* a tree larger than the buffer, with long strings written directly or escaped */
+    MJ_init(&v);
+    MJ_set_array(&v, 0);
+    memset(big, 'a', sizeof(big));
+    for (i = 0; i < 2000; i++) {
+        big[i] = (i % 2) ? '"' : '\t';
+        MJ_set_number(MJ_pushback_array_element(&v), i * 0.25);
+        MJ_set_string(MJ_pushback_array_element(&v), big, i);
+        MJ_set_string(MJ_pushback_array_element(&v), big + 1000, i);
+        MJ_set_string(MJ_pushback_array_element(&v), big + 2000, i);
+        big[i] = 'a';
+    }
+    test_sink_init(&k);
+    MJ_writer_init(&w, test_sink_write, &k);
+    EXPECT_EQ_INT(MJ_WRITE_OK, MJ_write_value(&w, &v));
+    EXPECT_EQ_INT(MJ_WRITE_OK, MJ_writer_flush(&w));
+    json = MJ_stringify(&v, &length);
+    EXPECT_EQ_SIZE_T(length, k.size);
+    EXPECT_TRUE(length == k.size && memcmp(json, k.json, length) == 0);
+    free(json);
+    free(k.json);
+
+    /* a failing sink stops the writer */
+    test_sink_init(&k);
+    k.fail_after = 1;
+    MJ_writer_init(&w, test_sink_write, &k);
+    EXPECT_EQ_INT(MJ_WRITE_IO_ERROR, MJ_write_value(&w, &v));
+    EXPECT_EQ_INT(MJ_WRITE_IO_ERROR, MJ_writer_flush(&w));
+    EXPECT_EQ_SIZE_T(2, k.calls);
+    free(k.json);
+    MJ_free(&v);
+}
+
+#define TEST_WRITER_ERROR(error, calls)\
+    do {\
+        MJ_writer w;\
+        test_sink k;\
+        test_sink_init(&k);\
+        MJ_writer_init(&w, test_sink_write, &k);\
+        calls;\
+        EXPECT_EQ_INT(error, MJ_writer_flush(&w));\
+        free(k.json);\
+    } while(0)
+
+static void test_writer_error()
+{
+    size_t i;
+    TEST_WRITER_ERROR(MJ_WRITE_INVALID_STATE, MJ_write_null(&w); MJ_write_null(&w));
+    TEST_WRITER_ERROR(MJ_WRITE_INVALID_STATE, MJ_write_key(&w, "a", 1));
+    TEST_WRITER_ERROR(MJ_WRITE_INVALID_STATE, MJ_write_begin_array(&w); MJ_write_key(&w, "a", 1));
+    TEST_WRITER_ERROR(MJ_WRITE_INVALID_STATE, MJ_write_begin_object(&w); MJ_write_null(&w));
+    TEST_WRITER_ERROR(MJ_WRITE_INVALID_STATE, MJ_write_begin_object(&w); MJ_write_key(&w, "a", 1); MJ_write_key(&w, "b", 1));
+    TEST_WRITER_ERROR(MJ_WRITE_INVALID_STATE, MJ_write_begin_object(&w); MJ_write_key(&w, "a", 1); MJ_write_end_object(&w));
+    TEST_WRITER_ERROR(MJ_WRITE_INVALID_STATE, MJ_write_begin_object(&w); MJ_write_end_array(&w));
+    TEST_WRITER_ERROR(MJ_WRITE_INVALID_STATE, MJ_write_end_array(&w));
+    TEST_WRITER_ERROR(MJ_WRITE_INVALID_STATE, (void)0);
+    TEST_WRITER_ERROR(MJ_WRITE_INVALID_STATE, MJ_write_begin_object(&w));
+    TEST_WRITER_ERROR(MJ_WRITE_INVALID_STATE, MJ_write_begin_object(&w); MJ_write_key(&w, "a", 1));
+    TEST_WRITER_ERROR(MJ_WRITE_INVALID_STATE, MJ_write_begin_array(&w); MJ_write_begin_array(&w); MJ_write_end_array(&w));
+    TEST_WRITER_ERROR(MJ_WRITE_INVALID_VALUE, MJ_write_number(&w, HUGE_VAL - HUGE_VAL));
+    TEST_WRITER_ERROR(MJ_WRITE_INVALID_VALUE, MJ_write_begin_array(&w); MJ_write_number(&w, -HUGE_VAL); MJ_write_end_array(&w));
+    TEST_WRITER_ERROR(MJ_WRITE_TOO_DEEP, for (i = 0; i < MJ_WRITER_MAX_DEPTH; i++) MJ_write_begin_array(&w));
+}
+
+#define TEST_BINARY_ROUNDTRIP(json)\
+    do {\
+        MJ_value v1, v2;\
+        char* data;\
+        size_t length;\
+        MJ_init(&v1);\
+        EXPECT_EQ_INT(MJ_PARSE_OK, MJ_parse(&v1, json));\
+        data = MJ_encode_binary(&v1, &length);\
+        EXPECT_EQ_INT(MJ_PARSE_OK, MJ_decode_binary(&v2, data, length));\
+        EXPECT_TRUE(MJ_is_equal(&v1, &v2));\
+        MJ_free(&v1);\
+        MJ_free(&v2);\
+        free(data);\
+    } while(0)
+
+static void test_binary()
+{
+    MJ_value v;
+    char *data, *text;
+    size_t length, text_length, i;
+
+    TEST_BINARY_ROUNDTRIP("null");
+    TEST_BINARY_ROUNDTRIP("false");
+    TEST_BINARY_ROUNDTRIP("true");
+    TEST_BINARY_ROUNDTRIP("0");
+    TEST_BINARY_ROUNDTRIP("-1");
+    TEST_BINARY_ROUNDTRIP("2147483647");
+    TEST_BINARY_ROUNDTRIP("-2147483648");
+    TEST_BINARY_ROUNDTRIP("4294967296");
+    TEST_BINARY_ROUNDTRIP("1.5");
+    TEST_BINARY_ROUNDTRIP("-4.9406564584124654e-324");
+    TEST_BINARY_ROUNDTRIP("1.7976931348623157e+308");
+    TEST_BINARY_ROUNDTRIP("\"\"");
+    TEST_BINARY_ROUNDTRIP("\"Hello\\u0000World\\n\"");
+    TEST_BINARY_ROUNDTRIP("[]");
+    TEST_BINARY_ROUNDTRIP("{}");
+    TEST_BINARY_ROUNDTRIP("{\"n\":null,\"f\":false,\"t\":true,\"i\":123,\"s\":\"abc\",\"a\":[1,2,3],\"o\":{\"1\":1,\"2\":2,\"3\":3},\"\":[[],{}]}");
+
+    /* -0 keeps its sign */
+    MJ_init(&v);
+    MJ_parse(&v, "-0");
+    data = MJ_encode_binary(&v, &length);
+    MJ_free(&v);
+    EXPECT_EQ_INT(MJ_PARSE_OK, MJ_decode_binary(&v, data, length));
+    EXPECT_TRUE(1.0 / MJ_get_number(&v) < 0);
+    free(data);
+
+    /* smaller than the text, every truncation is an error and nothing leaks */
+    MJ_init(&v);
+    MJ_parse(&v, "{\"a\":[1,2.5,\"xyz\",{\"b\":null}],\"c\":true}");
+    data = MJ_encode_binary(&v, &length);
+    text = MJ_stringify(&v, &text_length);
+    EXPECT_TRUE(length < text_length);
+    free(text);
+    MJ_free(&v);
+    for (i = 0; i < length; i++) {
+        EXPECT_EQ_INT(MJ_PARSE_INVALID_VALUE, MJ_decode_binary(&v, data, i));
+        EXPECT_EQ_INT(MJ_NULL, MJ_get_type(&v));
+    }
+    EXPECT_EQ_INT(MJ_PARSE_OK, MJ_decode_binary(&v, data, length));
+    MJ_free(&v);
+    free(data);
+
+    EXPECT_EQ_INT(MJ_PARSE_INVALID_VALUE, MJ_decode_binary(&v, "\x09", 1));
+    EXPECT_EQ_INT(MJ_PARSE_INVALID_VALUE, MJ_decode_binary(&v, "\x06\xFF\xFF\xFF\x0F", 5));
+    EXPECT_EQ_INT(MJ_PARSE_ROOT_NOT_SINGULAR, MJ_decode_binary(&v, "\x00\x00", 2));
+}
+
+static MJ_document* test_document(const char* json)
+{
+    MJ_value v;
+    MJ_init(&v);
+    EXPECT_EQ_INT(MJ_PARSE_OK, MJ_parse(&v, json));
+    return MJ_freeze(&v);
+}
+
+#ifdef MJ_ENABLE_THREADS
+typedef struct {
+    MJ_shared* s;
+    size_t torn;
+} test_reader;
+
+static void* test_shared_reader(void* arg)
+{
+    test_reader* r = (test_reader*)arg;
+    size_t i;
+    for (i = 0; i < 20000; i++) {
+        MJ_document* d = MJ_shared_acquire(r->s);
+        const MJ_value* v = MJ_document_root(d);
+        if (MJ_get_array_size(v) != 2 ||
+            MJ_get_number(MJ_get_array_element(v, 0)) != MJ_get_number(MJ_get_array_element(v, 1)))
+            r->torn++;
+        MJ_document_release(d);
+    }
+    return NULL;
+}
+#endif
+
+static void test_shared()
+{
+    MJ_value v;
+    MJ_document *d, *d2;
+    MJ_shared* s;
+
+    MJ_init(&v);
+    EXPECT_EQ_INT(MJ_PARSE_OK, MJ_parse(&v, "{\"a\":[1,2]}"));
+    d = MJ_freeze(&v);
+    EXPECT_EQ_INT(MJ_NULL, MJ_get_type(&v));
+    EXPECT_EQ_INT(MJ_OBJECT, MJ_get_type(MJ_document_root(d)));
+    MJ_document_retain(d);
+    MJ_document_release(d);
+
+    s = MJ_shared_create(d);
+    d = MJ_shared_acquire(s);
+    EXPECT_EQ_SIZE_T(1, MJ_get_object_size(MJ_document_root(d)));
+    MJ_shared_swap(s, test_document("[true]"));
+    /* an old version stays readable while referenced */
+    EXPECT_EQ_SIZE_T(0, MJ_find_object_index(MJ_document_root(d), "a", 1));
+    d2 = MJ_shared_acquire(s);
+    EXPECT_EQ_INT(MJ_ARRAY, MJ_get_type(MJ_document_root(d2)));
+    MJ_document_release(d);
+    MJ_document_release(d2);
+    MJ_shared_destroy(s);
+    MJ_reclaim_wait();
+
+#ifdef MJ_ENABLE_THREADS
+    {
+        pthread_t tid[4];
+        test_reader r[4];
+        char json[64];
+        size_t i;
+
+        s = MJ_shared_create(test_document("[0,0]"));
+        for (i = 0; i < 4; i++) {
+            r[i].s = s;
+            r[i].torn = 0;
+            EXPECT_EQ_INT(0, pthread_create(&tid[i], NULL, test_shared_reader, &r[i]));
+        }
+        for (i = 1; i <= 200; i++) {
+            sprintf(json, "[%u,%u]", (unsigned)i, (unsigned)i);
+            MJ_shared_swap(s, test_document(json));
+        }
+        for (i = 0; i < 4; i++) {
+            pthread_join(tid[i], NULL);
+            EXPECT_EQ_SIZE_T(0, r[i].torn);
+        }
+        d = MJ_shared_acquire(s);
+        EXPECT_EQ_DOUBLE(200.0, MJ_get_number(MJ_get_array_element(MJ_document_root(d), 0)));
+        MJ_document_release(d);
+        MJ_shared_destroy(s);
+        MJ_reclaim_wait();
+    }
+#endif
+}
+
 static void test_parse() 
 {
 	test_parse_null();
@@ -365,6 +1366,7 @@ static void test_parse()
 	test_parse_number();
     test_parse_string();
     test_parse_array();
+    test_parse_object();
 
 	test_parse_expect_value();
 	test_parse_invalid_value();
@@ -376,11 +1378,25 @@ static void test_parse()
     test_parse_invalid_unicode_hex();
     test_parse_invalid_unicode_surrogate();
     test_parse_miss_comma_or_square_bracket();
+    test_parse_object_error();
+    test_parse_struct();
+    test_validate();
+    test_parse_flags();
 
     test_access_null();
     test_access_boolean();
     test_access_number();
     test_access_string();
+    test_access_array();
+    test_access_object();
+
+    test_equal();
+    test_copy();
+    test_move();
+    test_swap();
+
+    test_merge_patch();
+    test_apply_patch();
 }
 
 int main() {
@@ -388,6 +1404,12 @@ int main() {
     _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
 	test_parse();
+    test_stringify();
+    test_stringify_parallel();
+    test_writer();
+    test_writer_error();
+    test_binary();
+    test_shared();
 	printf("%d/%d (%3.2f%%) passed\n", test_pass, test_count, test_pass * 100.0 / test_count);
 	return main_ret;
 }